@@ -7,18 +7,64 @@
  *
  *
  * Compile:
- *   gcc -std=c11 -O2 -o bitboard_checkers bitboard_checkers.c
+ *   gcc -std=c11 -O2 -pthread -o bitboard_checkers bitboard_checkers.c -lm
  *
  * Run:
  *   ./bitboard_checkers
+ *   ./bitboard_checkers perft <depth> [position] [--divide]
+ *   ./bitboard_checkers perft check [max_depth]
+ *   ./bitboard_checkers search [position] [--depth N] [--nodes N] [--time ms] [--hash MB] [--threads N]
+ *   ./bitboard_checkers stats [position] [--depth N] [--nodes N] [--time ms] [--hash MB] [--threads N]
+ *   ./bitboard_checkers play --engine red|black [--ponder] [--depth N] [--nodes N] [--time ms] [--hash MB] [--threads N]
+ *   ./bitboard_checkers smpbench [max_threads] [--depth N] [--hash MB]
+ *   ./bitboard_checkers tbgen <max_pieces> <file> [--threads N]
+ *   ./bitboard_checkers tbprobe <file> <position>
+ *   ./bitboard_checkers bitbench [boards]
+ *   ./bitboard_checkers evalbench [positions]
+ *   ./bitboard_checkers nnue gen <file> [seed] | nnue bench <file> [positions]
+ *   ./bitboard_checkers microbench [--reps N] [--positions N] [--seed N] [--json]
+ *   ./bitboard_checkers protocol          (engine protocol on stdin/stdout)
+ *   ./bitboard_checkers pdn [--threads N] [--errors N] <file.pdn>...
+ *   ./bitboard_checkers records convert [--threads N] [--compress] [--depth N] -o <out.rec> <file.pdn>...
+ *   ./bitboard_checkers records dump <file.rec> [first] [count]
+ *   ./bitboard_checkers match [--games N] [--threads N] [--openings file] [--a config] [--b config]
+ *                             [--maxply N] [--sprt elo0 elo1] [--pdn file] [--records file]
+ *   ./bitboard_checkers solve [--mb N] [--maxply N] [--time ms] [--tb file] [--file f] [position]...
+ *   ./bitboard_checkers batch [--threads N] [--depth N] [--nodes N] [--time ms] [--hash MB]
+ *                             [--multipv N] [--window N] <file|->
+ *   ./bitboard_checkers server [--port N | --unix path] [--shards N] [--games N]
+ *   ./bitboard_checkers loadgen [--port N | --unix path] [--games N] [--moves N]
+ *   ./bitboard_checkers mcts [position] [--nodes N] [--time ms] [--threads N] [--mb N] [--scale]
+ *   ./bitboard_checkers draughts perft <depth> [position] [--divide] | draughts check [max_depth]
+ *   (search and play also take --tb <file>; search, stats and play take --nnue <file>)
  *
  *
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
 #include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 /*
    Phase 1: Bit manipulation API
@@ -41,10 +87,7 @@ int GetBit32(unsigned int value, int position) {
     return (value >> position) & 1u;
 }
 int CountBits32(unsigned int value) {
-    /* Simple Kernighan's algorithm */
-    int count = 0;
-    while (value) { value &= (value - 1); count++; }
-    return count;
+    return __builtin_popcount(value);
 }
 unsigned int ShiftLeft32(unsigned int value, int positions) {
     if (positions < 0) return ShiftLeft32(value, 0);
@@ -85,9 +128,7 @@ int GetBit64(unsigned long long value, int position) {
     return (int)((value >> position) & 1ULL);
 }
 int CountBits64(unsigned long long value) {
-    int count = 0;
-    while (value) { value &= (value - 1ULL); count++; }
-    return count;
+    return __builtin_popcountll(value);
 }
 unsigned long long ShiftLeft64(unsigned long long value, int positions) {
     if (positions < 0) return ShiftLeft64(value, 0);
@@ -110,36 +151,307 @@ void PrintHex64(unsigned long long value) {
     printf("0x%llX\n", (unsigned long long)value);
 }
 
+/*
+
+   Phase 1 backends: hardware bit instructions
+
+   CountBits32/64 and LowestBit64 use the compiler builtins, so a build
+   with -march=native (or -mpopcnt -mbmi) turns the move generator's
+   inner loops into single POPCNT/TZCNT instructions.  Dispatching those
+   through a pointer per call costs more than it saves.
+
+   The rest goes through a BitBackend table chosen at runtime by CPUID:
+   PEXT/PDEP for Board32 packing and bulk popcounts over board arrays
+   (POPCNT, AVX2 nibble lookup, AVX-512 VPOPCNTDQ).  init_bitops()
+   installs the best one as `bitops`; bitbench times all of them.
+
+*/
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define BITOPS_X86 1
+#else
+#define BITOPS_X86 0
+#endif
+
+typedef struct {
+    const char *name;
+    int (*popcount64)(unsigned long long value);
+    int (*lsb64)(unsigned long long value);                  /* value != 0 */
+    unsigned long long (*clear_lsb64)(unsigned long long value);
+    unsigned long long (*pext64)(unsigned long long value, unsigned long long mask);
+    unsigned long long (*pdep64)(unsigned long long value, unsigned long long mask);
+    /* out[i] = popcount(boards[i] & mask) */
+    void (*popcount_array)(const unsigned long long *boards, unsigned long long mask,
+                           unsigned char *out, size_t n);
+    /* sum of popcount(boards[i]) */
+    unsigned long long (*popcount_sum)(const unsigned long long *boards, size_t n);
+} BitBackend;
+
+/* Portable fallbacks */
+static int popcount64_portable(unsigned long long value) {
+    int count = 0;
+    while (value) { value &= (value - 1ULL); count++; }
+    return count;
+}
+static int lsb64_portable(unsigned long long value) {
+    static const unsigned char DEBRUIJN[64] = {
+         0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+    };
+    return DEBRUIJN[((value & (0ULL - value)) * 0x03F79D71B4CB0A89ULL) >> 58];
+}
+static unsigned long long clear_lsb64_portable(unsigned long long value) {
+    return value & (value - 1ULL);
+}
+static unsigned long long pext64_portable(unsigned long long value, unsigned long long mask) {
+    unsigned long long out = 0ULL;
+    for (unsigned long long bit = 1ULL; mask; mask &= mask - 1ULL, bit <<= 1) {
+        if (value & mask & (0ULL - mask)) out |= bit;
+    }
+    return out;
+}
+static unsigned long long pdep64_portable(unsigned long long value, unsigned long long mask) {
+    unsigned long long out = 0ULL;
+    for (unsigned long long bit = 1ULL; mask; mask &= mask - 1ULL, bit <<= 1) {
+        if (value & bit) out |= mask & (0ULL - mask);
+    }
+    return out;
+}
+static void popcount_array_portable(const unsigned long long *boards, unsigned long long mask,
+                                    unsigned char *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = (unsigned char)popcount64_portable(boards[i] & mask);
+}
+static unsigned long long popcount_sum_portable(const unsigned long long *boards, size_t n) {
+    unsigned long long sum = 0ULL;
+    for (size_t i = 0; i < n; ++i) sum += (unsigned long long)popcount64_portable(boards[i]);
+    return sum;
+}
+
+static const BitBackend BITOPS_PORTABLE = {
+    "portable", popcount64_portable, lsb64_portable, clear_lsb64_portable,
+    pext64_portable, pdep64_portable, popcount_array_portable, popcount_sum_portable
+};
+
+#if BITOPS_X86
+#include <immintrin.h>
+
+/* POPCNT / BMI1 / BMI2 */
+#define BMI_TARGET __attribute__((target("popcnt,bmi,bmi2")))
+BMI_TARGET static int popcount64_hw(unsigned long long value) { return (int)_mm_popcnt_u64(value); }
+BMI_TARGET static int lsb64_hw(unsigned long long value) { return (int)_tzcnt_u64(value); }
+BMI_TARGET static unsigned long long clear_lsb64_hw(unsigned long long value) { return _blsr_u64(value); }
+BMI_TARGET static unsigned long long pext64_hw(unsigned long long value, unsigned long long mask) { return _pext_u64(value, mask); }
+BMI_TARGET static unsigned long long pdep64_hw(unsigned long long value, unsigned long long mask) { return _pdep_u64(value, mask); }
+BMI_TARGET static void popcount_array_hw(const unsigned long long *boards, unsigned long long mask,
+                                         unsigned char *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = (unsigned char)_mm_popcnt_u64(boards[i] & mask);
+}
+BMI_TARGET static unsigned long long popcount_sum_hw(const unsigned long long *boards, size_t n) {
+    unsigned long long sum = 0ULL;
+    for (size_t i = 0; i < n; ++i) sum += (unsigned long long)_mm_popcnt_u64(boards[i]);
+    return sum;
+}
+
+/* AVX2: 4 boards per vector, nibble lookup + byte sums (no vector popcount) */
+#define AVX2_TARGET __attribute__((target("avx2,popcnt,bmi,bmi2")))
+AVX2_TARGET static __m256i popcount256_epi64(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+AVX2_TARGET static void popcount_array_avx2(const unsigned long long *boards, unsigned long long mask,
+                                            unsigned char *out, size_t n) {
+    const __m256i m = _mm256_set1_epi64x((long long)mask);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i c = popcount256_epi64(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(boards + i)), m));
+        /* each count sits in the low byte of its 64-bit lane */
+        __m256i packed = _mm256_shuffle_epi8(c, _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                                 0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+        unsigned int lo = (unsigned int)_mm256_extract_epi16(packed, 0);
+        unsigned int hi = (unsigned int)_mm256_extract_epi16(packed, 8);
+        out[i] = (unsigned char)lo; out[i + 1] = (unsigned char)(lo >> 8);
+        out[i + 2] = (unsigned char)hi; out[i + 3] = (unsigned char)(hi >> 8);
+    }
+    for (; i < n; ++i) out[i] = (unsigned char)_mm_popcnt_u64(boards[i] & mask);
+}
+AVX2_TARGET static unsigned long long popcount_sum_avx2(const unsigned long long *boards, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_add_epi64(acc, popcount256_epi64(_mm256_loadu_si256((const __m256i *)(boards + i))));
+    unsigned long long lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    unsigned long long sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < n; ++i) sum += (unsigned long long)_mm_popcnt_u64(boards[i]);
+    return sum;
+}
+
+/* AVX-512 VPOPCNTDQ: 8 boards per vector */
+#define AVX512_TARGET __attribute__((target("avx512f,avx512vpopcntdq,popcnt,bmi,bmi2")))
+AVX512_TARGET static void popcount_array_avx512(const unsigned long long *boards, unsigned long long mask,
+                                                unsigned char *out, size_t n) {
+    const __m512i m = _mm512_set1_epi64((long long)mask);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i c = _mm512_popcnt_epi64(_mm512_and_si512(_mm512_loadu_si512(boards + i), m));
+        _mm_storel_epi64((__m128i *)(out + i), _mm512_cvtepi64_epi8(c));
+    }
+    for (; i < n; ++i) out[i] = (unsigned char)_mm_popcnt_u64(boards[i] & mask);
+}
+AVX512_TARGET static unsigned long long popcount_sum_avx512(const unsigned long long *boards, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(boards + i)));
+    unsigned long long sum = (unsigned long long)_mm512_reduce_add_epi64(acc);
+    for (; i < n; ++i) sum += (unsigned long long)_mm_popcnt_u64(boards[i]);
+    return sum;
+}
+
+static const BitBackend BITOPS_BMI2 = {
+    "popcnt+bmi2", popcount64_hw, lsb64_hw, clear_lsb64_hw,
+    pext64_hw, pdep64_hw, popcount_array_hw, popcount_sum_hw
+};
+static const BitBackend BITOPS_AVX2 = {
+    "avx2", popcount64_hw, lsb64_hw, clear_lsb64_hw,
+    pext64_hw, pdep64_hw, popcount_array_avx2, popcount_sum_avx2
+};
+static const BitBackend BITOPS_AVX512 = {
+    "avx512", popcount64_hw, lsb64_hw, clear_lsb64_hw,
+    pext64_hw, pdep64_hw, popcount_array_avx512, popcount_sum_avx512
+};
+#endif
+
+static BitBackend active_bitops;
+const BitBackend *bitops = &BITOPS_PORTABLE;
+
+/* Fills list[] with every backend this CPU can run, best last. */
+int available_bitops(const BitBackend **list) {
+    int n = 0;
+    list[n++] = &BITOPS_PORTABLE;
+#if BITOPS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2")) {
+        list[n++] = &BITOPS_BMI2;
+        if (__builtin_cpu_supports("avx2")) list[n++] = &BITOPS_AVX2;
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) list[n++] = &BITOPS_AVX512;
+    }
+#endif
+    return n;
+}
+
+/* Picks the best backend.  PEXT/PDEP are microcoded (very slow) on AMD
+   Zen 1/2, so there the portable versions are kept for those two. */
+void init_bitops(void) {
+    const BitBackend *list[4];
+    int n = available_bitops(list);
+    active_bitops = *list[n - 1];
+#if BITOPS_X86
+    if (__builtin_cpu_is("znver1") || __builtin_cpu_is("znver2")) {
+        active_bitops.pext64 = pext64_portable;
+        active_bitops.pdep64 = pdep64_portable;
+    }
+#endif
+    bitops = &active_bitops;
+}
+
 /*
 
    Phase 2: Checkers game (bitboard)
 
 */
 
+/* Board geometry.  A board is N x N squares, bit idx = row*N + col of an
+   unsigned integer type T with at least N*N bits; the dark squares are
+   those with (row + col) odd.  The GEOM_* masks are constant expressions,
+   so each variant gets its masks at compile time.
+
+   BOARD_SIZE names the geometry of this engine; it is not a build
+   option.  Board32, PDN square numbers, tablebases, position records
+   and the NNUE inputs all assume the 32 dark squares of an 8x8 board.
+   Another board is a separate code path on its own word type, built
+   from the same macros (see International draughts). */
+#define GEOM_ALL(T, N)      (((((T)1 << ((N) * (N) - 1)) - 1) << 1) | 1)
+#define GEOM_ROW(T, N, r)   ((((T)1 << (N)) - 1) << ((r) * (N)))
+#define GEOM_FILE(T, N, c)  ((GEOM_ALL(T, N) / (((T)1 << (N)) - 1)) << (c))
+#define GEOM_EVEN_ROWS(T, N) (GEOM_ALL(T, N) / (((T)1 << (2 * (N))) - 1))       /* bit 0 of rows 0, 2, ... */
+#define GEOM_EVEN_COLS(T, N) ((((T)1 << (N)) - 1) / 3)                           /* cols 0, 2, ... of row 0 */
+#define GEOM_DARK(T, N)     ((GEOM_EVEN_COLS(T, N) << 1) * GEOM_EVEN_ROWS(T, N) | \
+                             GEOM_EVEN_COLS(T, N) * (GEOM_EVEN_ROWS(T, N) << (N)))
+
+#define BOARD_SIZE     8
+#define BOARD_SQUARES  (BOARD_SIZE * BOARD_SIZE)
+#define SQ_INDEX(r, c) ((r) * BOARD_SIZE + (c))
+#define SQ_ROW(idx)    ((idx) / BOARD_SIZE)
+#define SQ_COL(idx)    ((idx) % BOARD_SIZE)
+
+_Static_assert(BOARD_SIZE == 8, "the checkers engine is 8x8 only; see the comment above");
+
 typedef struct {
     unsigned long long red_man;
     unsigned long long red_king;
     unsigned long long blk_man;
     unsigned long long blk_king;
+    unsigned long long key;      /* Zobrist key, see compute_key() */
     int turn;
 } GameState;
 
+/* Zobrist keys: one random number per (piece kind, square), plus one
+   for black to move.  GameState.key is kept up to date by make_move()
+   and recomputed from scratch by compute_key().  main() fills the
+   tables with init_zobrist() before any thread starts. */
+enum { Z_RED_MAN, Z_RED_KING, Z_BLK_MAN, Z_BLK_KING };
+
+unsigned long long ZOBRIST[4][BOARD_SQUARES];
+unsigned long long ZOBRIST_SIDE;
+
+unsigned long long splitmix64(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void init_zobrist(void) {
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    for (int k = 0; k < 4; ++k)
+        for (int sq = 0; sq < BOARD_SQUARES; ++sq) ZOBRIST[k][sq] = splitmix64(&seed);
+    ZOBRIST_SIDE = splitmix64(&seed);
+}
+
+unsigned long long compute_key(GameState *g) {
+    unsigned long long boards[4] = { g->red_man, g->red_king, g->blk_man, g->blk_king };
+    unsigned long long key = (g->turn == 1) ? ZOBRIST_SIDE : 0ULL;
+    for (int k = 0; k < 4; ++k) {
+        for (int idx = 0; idx < BOARD_SQUARES; ++idx) {
+            if ((boards[k] >> idx) & 1ULL) key ^= ZOBRIST[k][idx];
+        }
+    }
+    return key;
+}
+
 /* Helpers for coordinate conversions */
 int coord_to_index(const char *sq) {
     if (!sq || strlen(sq) < 2) return -1;
     char file = tolower(sq[0]);
     char rank_c = sq[1];
-    if (file < 'a' || file > 'h') return -1;
-    if (rank_c < '1' || rank_c > '8') return -1;
+    if (file < 'a' || file >= 'a' + BOARD_SIZE) return -1;
+    if (rank_c < '1' || rank_c >= '1' + BOARD_SIZE) return -1;
     int col = file - 'a';
     int row = rank_c - '1';
-    return row * 8 + col;
+    return SQ_INDEX(row, col);
 }
 void index_to_coord(int idx, char *out) {
     if (!out) return;
-    if (idx < 0 || idx >= 64) { out[0] = '?'; out[1] = '\0'; return; }
-    int row = idx / 8;
-    int col = idx % 8;
+    if (idx < 0 || idx >= BOARD_SQUARES) { out[0] = '?'; out[1] = '\0'; return; }
+    int row = SQ_ROW(idx);
+    int col = SQ_COL(idx);
     out[0] = 'a' + col;
     out[1] = '1' + row;
     out[2] = '\0';
@@ -156,7 +468,7 @@ unsigned long long all_pieces(GameState *g) {
 }
 
 int is_occupied(GameState *g, int idx) {
-    if (idx < 0 || idx >= 64) return 0;
+    if (idx < 0 || idx >= BOARD_SQUARES) return 0;
     return GetBit64(all_pieces(g), idx);
 }
 int is_red_piece(GameState *g, int idx) {
@@ -177,30 +489,45 @@ void init_game(GameState *g) {
     g->turn = 0;
 
     for (int r = 0; r < 3; ++r) {
-        for (int c = 0; c < 8; ++c) {
+        for (int c = 0; c < BOARD_SIZE; ++c) {
             if ((r + c) % 2 == 1) {
-                int idx = r * 8 + c;
+                int idx = SQ_INDEX(r, c);
                 g->red_man = SetBit64(g->red_man, idx);
             }
         }
     }
-    for (int r = 5; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
+    for (int r = BOARD_SIZE - 3; r < BOARD_SIZE; ++r) {
+        for (int c = 0; c < BOARD_SIZE; ++c) {
             if ((r + c) % 2 == 1) {
-                int idx = r * 8 + c;
+                int idx = SQ_INDEX(r, c);
                 g->blk_man = SetBit64(g->blk_man, idx);
             }
         }
     }
+    g->key = compute_key(g);
+}
+
+
+static void print_files(void) {
+    printf("   ");
+    for (int c = 0; c < BOARD_SIZE; ++c) printf(" %c", 'a' + c);
+    printf("\n");
 }
 
+static void print_rule(void) {
+    printf("   ");
+    for (int c = 0; c <= 2 * BOARD_SIZE; ++c) putchar('-');
+    printf("\n");
+}
 
 void print_board(GameState *g) {
-    printf("\n    a b c d e f g h\n   -----------------\n");
-    for (int r = 0; r < 8; ++r) {
+    printf("\n");
+    print_files();
+    print_rule();
+    for (int r = 0; r < BOARD_SIZE; ++r) {
         printf("%d | ", r + 1);
-        for (int c = 0; c < 8; ++c) {
-            int idx = r * 8 + c;
+        for (int c = 0; c < BOARD_SIZE; ++c) {
+            int idx = SQ_INDEX(r, c);
             char ch;
             if (is_red_piece(g, idx)) {
                 if (GetBit64(g->red_king, idx)) ch = 'R';
@@ -215,12 +542,13 @@ void print_board(GameState *g) {
         }
         printf("\n");
     }
-    printf("   -----------------\n");
-    printf("    a b c d e f g h\n\n");
+    print_rule();
+    print_files();
+    printf("\n");
 }
 
 int on_board(int r, int c) {
-    return (r >= 0 && r < 8 && c >= 0 && c < 8);
+    return (r >= 0 && r < BOARD_SIZE && c >= 0 && c < BOARD_SIZE);
 }
 
 
@@ -228,44 +556,286 @@ int is_playable_square(int r, int c) {
     return ((r + c) % 2 == 1);
 }
 
-int player_has_capture(GameState *g, int player /*0=red,1=black*/) {
-    unsigned long long men = (player == 0) ? g->red_man : g->blk_man;
-    unsigned long long kings = (player == 0) ? g->red_king : g->blk_king;
-    unsigned long long opponent = (player == 0) ? all_black(g) : all_red(g);
+/*
+
+   Set-wise move generation
+
+   With idx = row*8 + col a diagonal step is a whole-board shift:
+     down-right +9, down-left +7, up-right -7, up-left -9
+   (BOARD_SIZE +- 1).
+   The file masks stop pieces on the a/h files from wrapping onto the
+   next row, so every mover/jumper of one side is found with a handful of
+   shifts instead of a per-square loop.
+
+*/
+
+#define FILE_A_MASK   GEOM_FILE(unsigned long long, BOARD_SIZE, 0)
+#define FILE_H_MASK   GEOM_FILE(unsigned long long, BOARD_SIZE, BOARD_SIZE - 1)
+#define DARK_SQUARES  GEOM_DARK(unsigned long long, BOARD_SIZE)           /* (r + c) % 2 == 1 */
+#define ROW_1_MASK    GEOM_ROW(unsigned long long, BOARD_SIZE, 0)         /* black promotes here */
+#define ROW_8_MASK    GEOM_ROW(unsigned long long, BOARD_SIZE, BOARD_SIZE - 1)   /* red promotes here */
+
+_Static_assert(DARK_SQUARES == 0x55AA55AA55AA55AAULL && FILE_H_MASK == 0x8080808080808080ULL,
+               "geometry masks");
+
+#define MAX_MOVES 128
+#define MAX_JUMPS 16
+
+/* Directions; the opposite direction of d is d ^ 3.
+   Red men only use DR/DL (down), black men only UR/UL (up). */
+enum { DIR_DR = 0, DIR_DL = 1, DIR_UR = 2, DIR_UL = 3 };
+
+typedef struct {
+    unsigned long long from;       /* bit of the origin square */
+    unsigned long long to;         /* bit of the final landing square */
+    unsigned long long cap_men;    /* opponent men removed by the move */
+    unsigned long long cap_kings;  /* opponent kings removed by the move */
+    unsigned char from_idx;
+    unsigned char to_idx;
+    unsigned char promote;         /* a man reached the far row */
+    unsigned char njumps;          /* 0 for a simple move */
+    unsigned char path[MAX_JUMPS]; /* landing square of every jump */
+} Move;
+
+int LowestBit64(unsigned long long value) {
+    if (!value) return -1;
+    return __builtin_ctzll(value);
+}
+
+static inline unsigned long long shift_dir(unsigned long long b, int dir) {
+    switch (dir) {
+    case DIR_DR: return (b & ~FILE_H_MASK) << (BOARD_SIZE + 1);
+    case DIR_DL: return (b & ~FILE_A_MASK) << (BOARD_SIZE - 1);
+    case DIR_UR: return (b & ~FILE_H_MASK) >> (BOARD_SIZE - 1);
+    default:     return (b & ~FILE_A_MASK) >> (BOARD_SIZE + 1);
+    }
+}
+
+/* Pieces of `player` that have at least one simple (non-capturing) move. */
+unsigned long long movers_mask(GameState *g, int player) {
+    unsigned long long men = (player==0) ? g->red_man : g->blk_man;
+    unsigned long long kings = (player==0) ? g->red_king : g->blk_king;
+    unsigned long long empty = ~all_pieces(g) & DARK_SQUARES;
+    int fwd = (player==0) ? DIR_DR : DIR_UR;
+    unsigned long long m = 0ULL;
+    for (int d = 0; d < 4; ++d) {
+        unsigned long long pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+        m |= shift_dir(empty, d ^ 3) & pieces;
+    }
+    return m;
+}
+
+/* Pieces of `player` that can start a capturing jump. */
+unsigned long long jumpers_mask(GameState *g, int player) {
+    unsigned long long men = (player==0) ? g->red_man : g->blk_man;
+    unsigned long long kings = (player==0) ? g->red_king : g->blk_king;
+    unsigned long long opponent = (player==0) ? all_black(g) : all_red(g);
+    unsigned long long empty = ~all_pieces(g) & DARK_SQUARES;
+    int fwd = (player==0) ? DIR_DR : DIR_UR;
+    unsigned long long j = 0ULL;
+    for (int d = 0; d < 4; ++d) {
+        unsigned long long pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+        j |= shift_dir(shift_dir(empty, d ^ 3) & opponent, d ^ 3) & pieces;
+    }
+    return j;
+}
+
+typedef struct {
+    Move *moves;
+    int count;
+    int player;
+    int is_king;
+    unsigned long long opp_kings;  /* opponent kings before the move */
+} JumpCtx;
+
+/* Extend the jump chain in *cur from square bit `at`.  `occ` and `opp`
+   already have the moving piece and every captured piece removed, so a
+   piece can never be jumped twice.  A man that is crowned ends its move. */
+static void jump_chain(JumpCtx *ctx, Move *cur, unsigned long long at,
+                       unsigned long long occ, unsigned long long opp) {
+    int fwd = (ctx->player==0) ? DIR_DR : DIR_UR;
+    int extended = 0;
+    for (int d = 0; d < 4; ++d) {
+        if (!ctx->is_king && d != fwd && d != fwd + 1) continue;
+        unsigned long long mid = shift_dir(at, d) & opp;
+        if (!mid) continue;
+        unsigned long long land = shift_dir(mid, d) & ~occ & DARK_SQUARES;
+        if (!land || cur->njumps >= MAX_JUMPS) continue;
+        extended = 1;
+
+        Move next = *cur;
+        next.path[next.njumps++] = (unsigned char)LowestBit64(land);
+        if (mid & ctx->opp_kings) next.cap_kings |= mid;
+        else next.cap_men |= mid;
+        next.to = land;
+        next.to_idx = next.path[next.njumps - 1];
+        if (!ctx->is_king && (land & (ctx->player==0 ? ROW_8_MASK : ROW_1_MASK))) {
+            next.promote = 1;
+            if (ctx->count < MAX_MOVES) ctx->moves[ctx->count++] = next;
+            continue;
+        }
+        jump_chain(ctx, &next, land, occ & ~mid, opp & ~mid);
+    }
+    if (!extended && cur->njumps > 0 && ctx->count < MAX_MOVES) {
+        ctx->moves[ctx->count++] = *cur;
+    }
+}
+
+/* Only the capturing moves of `player`, every multi-jump chain expanded. */
+int generate_captures(GameState *g, int player, Move *moves) {
+    JumpCtx ctx;
+    ctx.moves = moves;
+    ctx.count = 0;
+    ctx.player = player;
+    ctx.opp_kings = (player==0) ? g->blk_king : g->red_king;
+    unsigned long long kings = (player==0) ? g->red_king : g->blk_king;
+    unsigned long long opponent = (player==0) ? all_black(g) : all_red(g);
     unsigned long long occupied = all_pieces(g);
 
-    for (int idx = 0; idx < 64; ++idx) {
-        if (GetBit64(men | kings, idx) == 0) continue;
-        int r = idx / 8, c = idx % 8;
-        int directions[4][2] = {{1,1}, {1,-1}, {-1,1}, {-1,-1}};
-        for (int d = 0; d < 4; ++d) {
-            int dr = directions[d][0], dc = directions[d][1];
-            if (GetBit64(men, idx)) {
-                if (player == 0 && dr < 0) continue;
-                if (player == 1 && dr > 0) continue;
-            }
-            int midr = r + dr, midc = c + dc;
-            int endr = r + 2*dr, endc = c + 2*dc;
-            if (!on_board(midr, midc) || !on_board(endr, endc)) continue;
-            if (!is_playable_square(midr, midc) || !is_playable_square(endr, endc)) continue;
-            int midi = midr*8 + midc, endi = endr*8 + endc;
-            if (GetBit64(opponent, midi) && !GetBit64(occupied, endi)) {
-                return 1;
-            }
+    unsigned long long jumpers = jumpers_mask(g, player);
+    while (jumpers) {
+        int sq = LowestBit64(jumpers);
+        unsigned long long from = jumpers & (0ULL - jumpers);
+        jumpers &= jumpers - 1;
+        Move m;
+        memset(&m, 0, sizeof(m));
+        m.from = from;
+        m.from_idx = (unsigned char)sq;
+        ctx.is_king = (kings & from) != 0;
+        jump_chain(&ctx, &m, from, occupied & ~from, opponent);
+    }
+    return ctx.count;
+}
+
+/* Complete legal move list for `player` into moves[MAX_MOVES].
+   Captures are mandatory, so simple moves are only listed when no
+   jump exists.  Returns the number of moves written. */
+int generate_moves(GameState *g, int player, Move *moves) {
+    int n = generate_captures(g, player, moves);
+    if (n) return n;
+
+    unsigned long long men = (player==0) ? g->red_man : g->blk_man;
+    unsigned long long kings = (player==0) ? g->red_king : g->blk_king;
+    unsigned long long empty = ~all_pieces(g) & DARK_SQUARES;
+    unsigned long long crown = (player==0) ? ROW_8_MASK : ROW_1_MASK;
+    int fwd = (player==0) ? DIR_DR : DIR_UR;
+    for (int d = 0; d < 4; ++d) {
+        unsigned long long pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+        unsigned long long targets = shift_dir(pieces, d) & empty;
+        while (targets && n < MAX_MOVES) {
+            unsigned long long to = targets & (0ULL - targets);
+            targets &= targets - 1;
+            unsigned long long from = shift_dir(to, d ^ 3);
+            Move *m = &moves[n++];
+            m->from = from;
+            m->to = to;
+            m->cap_men = 0ULL;
+            m->cap_kings = 0ULL;
+            m->from_idx = (unsigned char)LowestBit64(from);
+            m->to_idx = (unsigned char)LowestBit64(to);
+            m->promote = (men & from) && (to & crown);
+            m->njumps = 0;
         }
     }
-    return 0;
+    return n;
+}
+
+/* Undo record for make_move()/unmake_move(): the XOR applied to each
+   board plus the previous key, so unmaking is a handful of XORs. */
+typedef struct {
+    unsigned long long red_man;
+    unsigned long long red_king;
+    unsigned long long blk_man;
+    unsigned long long blk_king;
+    unsigned long long key;
+} Undo;
+
+/* Play a move from generate_moves() for the side to move and pass the
+   turn, recording what changed in *u.  No validation: the move must
+   come from the generator for this position.  Every update is an XOR,
+   so a king whose jump chain ends on its own origin square
+   (from == to) is handled too. */
+void make_move(GameState *g, const Move *m, Undo *u) {
+    int me = (g->turn==0) ? Z_RED_MAN : Z_BLK_MAN;
+    int opp = (g->turn==0) ? Z_BLK_MAN : Z_RED_MAN;
+    unsigned long long my_man = 0ULL, my_king = 0ULL;
+    unsigned long long key = g->key ^ ZOBRIST_SIDE;
+    u->key = g->key;
+    if (((g->turn==0) ? g->red_king : g->blk_king) & m->from) {
+        my_king = m->from ^ m->to;
+        key ^= ZOBRIST[me + 1][m->from_idx] ^ ZOBRIST[me + 1][m->to_idx];
+    } else if (m->promote) {
+        my_man = m->from;
+        my_king = m->to;
+        key ^= ZOBRIST[me][m->from_idx] ^ ZOBRIST[me + 1][m->to_idx];
+    } else {
+        my_man = m->from ^ m->to;
+        key ^= ZOBRIST[me][m->from_idx] ^ ZOBRIST[me][m->to_idx];
+    }
+    for (unsigned long long c = m->cap_men; c; c &= c - 1) key ^= ZOBRIST[opp][LowestBit64(c)];
+    for (unsigned long long c = m->cap_kings; c; c &= c - 1) key ^= ZOBRIST[opp + 1][LowestBit64(c)];
+    if (g->turn == 0) {
+        u->red_man = my_man; u->red_king = my_king;
+        u->blk_man = m->cap_men; u->blk_king = m->cap_kings;
+    } else {
+        u->blk_man = my_man; u->blk_king = my_king;
+        u->red_man = m->cap_men; u->red_king = m->cap_kings;
+    }
+    g->red_man ^= u->red_man;
+    g->red_king ^= u->red_king;
+    g->blk_man ^= u->blk_man;
+    g->blk_king ^= u->blk_king;
+    g->key = key;
+    g->turn = 1 - g->turn;
+}
+
+/* Restores the position from before the make_move() that filled *u. */
+void unmake_move(GameState *g, const Undo *u) {
+    g->red_man ^= u->red_man;
+    g->red_king ^= u->red_king;
+    g->blk_man ^= u->blk_man;
+    g->blk_king ^= u->blk_king;
+    g->key = u->key;
+    g->turn = 1 - g->turn;
+}
+
+/* make_move() without keeping the undo record. */
+void apply_move(GameState *g, const Move *m) {
+    Undo u;
+    make_move(g, m, &u);
+}
+
+#define MOVE_STR_LEN 64
+
+/* "b3-c4" for a simple move, "b3xd5xf7" for a jump chain. */
+void move_to_string(const Move *m, char *out) {
+    index_to_coord(m->from_idx, out);
+    if (!m->njumps) {
+        out[2] = '-';
+        index_to_coord(m->to_idx, out + 3);
+        return;
+    }
+    char *p = out + 2;
+    for (int j = 0; j < m->njumps; ++j) {
+        *p++ = 'x';
+        index_to_coord(m->path[j], p);
+        p += 2;
+    }
+}
+
+int player_has_capture(GameState *g, int player /*0=red,1=black*/) {
+    return jumpers_mask(g, player) != 0ULL;
 }
 
 int validate_simple_move(GameState *g, int player, int from_idx, int to_idx, int *is_capture) {
     *is_capture = 0;
-    if (from_idx < 0 || to_idx < 0 || from_idx >=64 || to_idx>=64) return 0;
+    if (from_idx < 0 || to_idx < 0 || from_idx >= BOARD_SQUARES || to_idx >= BOARD_SQUARES) return 0;
     if (from_idx == to_idx) return 0;
     if (is_occupied(g, to_idx)) return 0;
     unsigned long long men = (player==0)? g->red_man : g->blk_man;
     unsigned long long kings = (player==0)? g->red_king : g->blk_king;
     if (!GetBit64(men | kings, from_idx)) return 0; /* no player's piece at from */
-    int fr = from_idx/8, fc = from_idx%8, tr = to_idx/8, tc = to_idx%8;
+    int fr = SQ_ROW(from_idx), fc = SQ_COL(from_idx), tr = SQ_ROW(to_idx), tc = SQ_COL(to_idx);
     if (!is_playable_square(tr,tc) || !is_playable_square(fr,fc)) return 0;
     int dr = tr - fr, dc = tc - fc;
     if (abs(dr) == 1 && abs(dc) == 1) {
@@ -277,7 +847,7 @@ int validate_simple_move(GameState *g, int player, int from_idx, int to_idx, int
     }
     if (abs(dr) == 2 && abs(dc) == 2) {
         int midr = fr + dr/2, midc = fc + dc/2;
-        int mid = midr*8 + midc;
+        int mid = SQ_INDEX(midr, midc);
         unsigned long long opponent = (player==0)? all_black(g) : all_red(g);
         if (GetBit64(opponent, mid)) {
             if (GetBit64(men, from_idx)) {
@@ -292,7 +862,7 @@ int validate_simple_move(GameState *g, int player, int from_idx, int to_idx, int
 }
 
 int execute_move(GameState *g, int player, int from_idx, int to_idx) {
-    if (from_idx < 0 || to_idx < 0 || from_idx >=64 || to_idx>=64) return -1;
+    if (from_idx < 0 || to_idx < 0 || from_idx >= BOARD_SQUARES || to_idx >= BOARD_SQUARES) return -1;
     unsigned long long *my_man = (player==0) ? &g->red_man : &g->blk_man;
     unsigned long long *my_king = (player==0) ? &g->red_king : &g->blk_king;
     unsigned long long *opp_man = (player==0) ? &g->blk_man : &g->red_man;
@@ -312,9 +882,9 @@ int execute_move(GameState *g, int player, int from_idx, int to_idx) {
     }
 
     if (is_cap) {
-        int fr = from_idx / 8, fc = from_idx % 8, tr = to_idx/8, tc = to_idx%8;
+        int fr = SQ_ROW(from_idx), fc = SQ_COL(from_idx), tr = SQ_ROW(to_idx), tc = SQ_COL(to_idx);
         int midr = (fr + tr) / 2, midc = (fc + tc) / 2;
-        int mid = midr*8 + midc;
+        int mid = SQ_INDEX(midr, midc);
         if (GetBit64(*opp_man, mid)) *opp_man = ClearBit64(*opp_man, mid);
         else if (GetBit64(*opp_king, mid)) *opp_king = ClearBit64(*opp_king, mid);
         else {
@@ -322,10 +892,10 @@ int execute_move(GameState *g, int player, int from_idx, int to_idx) {
     }
 
 
-    int tr = to_idx / 8;
+    int tr = SQ_ROW(to_idx);
     int promote = 0;
     if (!was_king) {
-        if (player == 0 && tr == 7) promote = 1;
+        if (player == 0 && tr == BOARD_SIZE - 1) promote = 1;
         if (player == 1 && tr == 0) promote = 1;
     }
     if (was_king || promote) {
@@ -336,7 +906,7 @@ int execute_move(GameState *g, int player, int from_idx, int to_idx) {
 
     if (is_cap) {
         unsigned long long opponent = all_pieces(g) ^ (all_red(g) | all_black(g)); /* placeholder; we'll compute */
-        int r = to_idx / 8, c = to_idx % 8;
+        int r = SQ_ROW(to_idx), c = SQ_COL(to_idx);
         unsigned long long mypieces = (player==0) ? g->red_man | g->red_king : g->blk_man | g->blk_king;
         unsigned long long opponentBB = (player==0) ? all_black(g) : all_red(g);
         int directions[4][2] = {{1,1}, {1,-1}, {-1,1}, {-1,-1}};
@@ -350,7 +920,7 @@ int execute_move(GameState *g, int player, int from_idx, int to_idx) {
             int endr = r + 2*dr, endc = c + 2*dc;
             if (!on_board(midr, midc) || !on_board(endr, endc)) continue;
             if (!is_playable_square(midr, midc) || !is_playable_square(endr, endc)) continue;
-            int mid = midr*8 + midc, end = endr*8 + endc;
+            int mid = SQ_INDEX(midr, midc), end = SQ_INDEX(endr, endc);
             if (GetBit64(opponentBB, mid) && !GetBit64(all_pieces(g), end)) {
                 return 2;
             }
@@ -361,39 +931,374 @@ int execute_move(GameState *g, int player, int from_idx, int to_idx) {
 }
 
 int player_has_any_move(GameState *g, int player) {
-    unsigned long long men = (player==0)? g->red_man : g->blk_man;
-    unsigned long long kings = (player==0)? g->red_king : g->blk_king;
-    unsigned long long occupied = all_pieces(g);
-    unsigned long long opponent = (player==0)? all_black(g) : all_red(g);
+    return (movers_mask(g, player) | jumpers_mask(g, player)) != 0ULL;
+}
 
-    for (int idx = 0; idx < 64; ++idx) {
-        if (!GetBit64(men | kings, idx)) continue;
-        int r = idx / 8, c = idx % 8;
-        int directions[4][2] = {{1,1}, {1,-1}, {-1,1}, {-1,-1}};
-        for (int d = 0; d < 4; ++d) {
-            int dr = directions[d][0], dc = directions[d][1];
-            if (GetBit64(men, idx)) {
-                if (player == 0 && dr < 0) continue;
-                if (player == 1 && dr > 0) continue;
-            }
-            int tr = r + dr, tc = c + dc;
-            if (on_board(tr, tc) && is_playable_square(tr,tc)) {
-                int tidx = tr*8 + tc;
-                if (!GetBit64(occupied, tidx)) return 1; /* simple move exists */
-            }
-            int midr = r + dr, midc = c + dc;
-            int endr = r + 2*dr, endc = c + 2*dc;
-            if (on_board(midr, midc) && on_board(endr, endc) && is_playable_square(midr,midc) && is_playable_square(endr,endc)) {
-                int mid = midr*8 + midc, endi = endr*8 + endc;
-                if (GetBit64(opponent, mid) && !GetBit64(occupied, endi)) return 1;
+int count_red(GameState *g) { return CountBits64(g->red_man) + CountBits64(g->red_king); }
+int count_black(GameState *g) { return CountBits64(g->blk_man) + CountBits64(g->blk_king); }
+
+/*
+
+   Compact 32-square board
+
+   Only the dark squares are ever occupied, so a position fits in four
+   32-bit boards (16 bytes).  Square s = row*4 + col/2, which is also the
+   usual 1..32 checkers numbering minus one (s0 = b1, s31 = g8).
+   Per row the step to a diagonal neighbour depends on row parity:
+     even rows: down-left +4, down-right +5, up-left -4, up-right -3
+     odd rows:  down-left +3, down-right +4, up-left -5, up-right -4
+   and two steps in the same direction are always +-7 / +-9.
+
+*/
+
+typedef struct {
+    unsigned int red_man;
+    unsigned int red_king;
+    unsigned int blk_man;
+    unsigned int blk_king;
+} Board32;
+
+#define S32_EVEN_ROWS   0x0F0F0F0Fu
+#define S32_ODD_ROWS    0xF0F0F0F0u
+#define S32_RIGHT_EDGE  0x08080808u   /* h-file squares (even rows) */
+#define S32_LEFT_EDGE   0x10101010u   /* a-file squares (odd rows) */
+#define S32_ROW_1       0x0000000Fu
+#define S32_ROW_8       0xF0000000u
+
+static const unsigned char SQ32_TO_INDEX[32] = {
+     1,  3,  5,  7,  8, 10, 12, 14,
+    17, 19, 21, 23, 24, 26, 28, 30,
+    33, 35, 37, 39, 40, 42, 44, 46,
+    49, 51, 53, 55, 56, 58, 60, 62
+};
+
+int square32_to_index(int sq) {
+    if (sq < 0 || sq >= 32) return -1;
+    return SQ32_TO_INDEX[sq];
+}
+int index_to_square32(int idx) {
+    if (idx < 0 || idx >= BOARD_SQUARES) return -1;
+    if (!is_playable_square(SQ_ROW(idx), SQ_COL(idx))) return -1;
+    return SQ_ROW(idx) * (BOARD_SIZE / 2) + SQ_COL(idx) / 2;
+}
+int coord_to_square32(const char *sq) {
+    return index_to_square32(coord_to_index(sq));
+}
+
+/* 64-bit board (dark squares only) <-> 32-bit board.  The dark squares
+   in index order are exactly squares 0..31, so this is PEXT/PDEP. */
+unsigned int pack_board32(unsigned long long bb) {
+    return (unsigned int)bitops->pext64(bb, DARK_SQUARES);
+}
+unsigned long long unpack_board32(unsigned int b) {
+    return bitops->pdep64((unsigned long long)b, DARK_SQUARES);
+}
+
+void gamestate_to_board32(GameState *g, Board32 *b) {
+    b->red_man = pack_board32(g->red_man);
+    b->red_king = pack_board32(g->red_king);
+    b->blk_man = pack_board32(g->blk_man);
+    b->blk_king = pack_board32(g->blk_king);
+}
+void board32_to_gamestate(const Board32 *b, int turn, GameState *g) {
+    g->red_man = unpack_board32(b->red_man);
+    g->red_king = unpack_board32(b->red_king);
+    g->blk_man = unpack_board32(b->blk_man);
+    g->blk_king = unpack_board32(b->blk_king);
+    g->turn = turn;
+    g->key = compute_key(g);
+}
+
+typedef struct {
+    unsigned int from;
+    unsigned int to;
+    unsigned int cap_men;
+    unsigned int cap_kings;
+    unsigned char from_sq;
+    unsigned char to_sq;
+    unsigned char promote;
+    unsigned char njumps;
+} Move32;
+
+static inline unsigned int shift32(unsigned int b, int dir) {
+    switch (dir) {
+    case DIR_DR: return ((b & S32_EVEN_ROWS & ~S32_RIGHT_EDGE) << 5) | ((b & S32_ODD_ROWS) << 4);
+    case DIR_DL: return ((b & S32_EVEN_ROWS) << 4) | ((b & S32_ODD_ROWS & ~S32_LEFT_EDGE) << 3);
+    case DIR_UR: return ((b & S32_EVEN_ROWS & ~S32_RIGHT_EDGE) >> 3) | ((b & S32_ODD_ROWS) >> 4);
+    default:     return ((b & S32_EVEN_ROWS) >> 4) | ((b & S32_ODD_ROWS & ~S32_LEFT_EDGE) >> 5);
+    }
+}
+
+unsigned int movers32(const Board32 *b, int player) {
+    unsigned int men = (player==0) ? b->red_man : b->blk_man;
+    unsigned int kings = (player==0) ? b->red_king : b->blk_king;
+    unsigned int empty = ~(b->red_man | b->red_king | b->blk_man | b->blk_king);
+    int fwd = (player==0) ? DIR_DR : DIR_UR;
+    unsigned int m = 0u;
+    for (int d = 0; d < 4; ++d) {
+        unsigned int pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+        m |= shift32(empty, d ^ 3) & pieces;
+    }
+    return m;
+}
+
+unsigned int jumpers32(const Board32 *b, int player) {
+    unsigned int men = (player==0) ? b->red_man : b->blk_man;
+    unsigned int kings = (player==0) ? b->red_king : b->blk_king;
+    unsigned int opponent = (player==0) ? (b->blk_man | b->blk_king) : (b->red_man | b->red_king);
+    unsigned int empty = ~(b->red_man | b->red_king | b->blk_man | b->blk_king);
+    int fwd = (player==0) ? DIR_DR : DIR_UR;
+    unsigned int j = 0u;
+    for (int d = 0; d < 4; ++d) {
+        unsigned int pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+        j |= shift32(shift32(empty, d ^ 3) & opponent, d ^ 3) & pieces;
+    }
+    return j;
+}
+
+typedef struct {
+    Move32 *moves;
+    int count;
+    int player;
+    int is_king;
+    unsigned int opp_kings;
+} JumpCtx32;
+
+static void jump_chain32(JumpCtx32 *ctx, Move32 *cur, unsigned int at,
+                         unsigned int occ, unsigned int opp) {
+    int fwd = (ctx->player==0) ? DIR_DR : DIR_UR;
+    int extended = 0;
+    for (int d = 0; d < 4; ++d) {
+        if (!ctx->is_king && d != fwd && d != fwd + 1) continue;
+        unsigned int mid = shift32(at, d) & opp;
+        if (!mid) continue;
+        unsigned int land = shift32(mid, d) & ~occ;
+        if (!land) continue;
+        extended = 1;
+
+        Move32 next = *cur;
+        next.njumps++;
+        if (mid & ctx->opp_kings) next.cap_kings |= mid;
+        else next.cap_men |= mid;
+        next.to = land;
+        next.to_sq = (unsigned char)__builtin_ctz(land);
+        if (!ctx->is_king && (land & (ctx->player==0 ? S32_ROW_8 : S32_ROW_1))) {
+            next.promote = 1;
+            if (ctx->count < MAX_MOVES) ctx->moves[ctx->count++] = next;
+            continue;
+        }
+        jump_chain32(ctx, &next, land, occ & ~mid, opp & ~mid);
+    }
+    if (!extended && cur->njumps > 0 && ctx->count < MAX_MOVES) {
+        ctx->moves[ctx->count++] = *cur;
+    }
+}
+
+/* Same rules as generate_moves(), working on the 32-square board. */
+int generate_moves32(const Board32 *b, int player, Move32 *moves) {
+    unsigned int men = (player==0) ? b->red_man : b->blk_man;
+    unsigned int kings = (player==0) ? b->red_king : b->blk_king;
+    unsigned int occupied = b->red_man | b->red_king | b->blk_man | b->blk_king;
+    int n = 0;
+
+    unsigned int jumpers = jumpers32(b, player);
+    if (jumpers) {
+        JumpCtx32 ctx;
+        ctx.moves = moves;
+        ctx.count = 0;
+        ctx.player = player;
+        ctx.opp_kings = (player==0) ? b->blk_king : b->red_king;
+        unsigned int opponent = (player==0) ? (b->blk_man | b->blk_king) : (b->red_man | b->red_king);
+        while (jumpers) {
+            unsigned int from = jumpers & (0u - jumpers);
+            jumpers &= jumpers - 1;
+            Move32 m;
+            memset(&m, 0, sizeof(m));
+            m.from = from;
+            m.from_sq = (unsigned char)__builtin_ctz(from);
+            ctx.is_king = (kings & from) != 0;
+            jump_chain32(&ctx, &m, from, occupied & ~from, opponent);
+        }
+        return ctx.count;
+    }
+
+    unsigned int empty = ~occupied;
+    unsigned int crown = (player==0) ? S32_ROW_8 : S32_ROW_1;
+    int fwd = (player==0) ? DIR_DR : DIR_UR;
+    for (int d = 0; d < 4; ++d) {
+        unsigned int pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+        unsigned int targets = shift32(pieces, d) & empty;
+        while (targets && n < MAX_MOVES) {
+            unsigned int to = targets & (0u - targets);
+            targets &= targets - 1;
+            unsigned int from = shift32(to, d ^ 3);
+            Move32 *m = &moves[n++];
+            m->from = from;
+            m->to = to;
+            m->cap_men = 0u;
+            m->cap_kings = 0u;
+            m->from_sq = (unsigned char)__builtin_ctz(from);
+            m->to_sq = (unsigned char)__builtin_ctz(to);
+            m->promote = (men & from) && (to & crown);
+            m->njumps = 0;
+        }
+    }
+    return n;
+}
+
+/* Play a move generated for `player` on b. */
+void apply_move32(Board32 *b, int player, const Move32 *m) {
+    unsigned int *my_man = (player==0) ? &b->red_man : &b->blk_man;
+    unsigned int *my_king = (player==0) ? &b->red_king : &b->blk_king;
+    if (*my_king & m->from) *my_king ^= m->from ^ m->to;
+    else if (m->promote) { *my_man ^= m->from; *my_king ^= m->to; }
+    else *my_man ^= m->from ^ m->to;
+    if (player == 0) { b->blk_man &= ~m->cap_men; b->blk_king &= ~m->cap_kings; }
+    else { b->red_man &= ~m->cap_men; b->red_king &= ~m->cap_kings; }
+}
+
+
+/*
+
+   Position strings (PDN FEN)
+
+   e.g. "B:W21,22,23,K30:B1,2,3,K12"
+   PDN numbers the dark squares 1..32 from the top-left (square n is
+   Board32 square n-1) and calls the side starting on 1..12 "Black".
+   In this program that side is red, so in a FEN "B" means red and
+   "W" means black.  Squares may also be written as coordinates ("b1")
+   and as ranges ("1-12").  "startpos" is the initial position.
+
+*/
+
+#define POSITION_STR_LEN 192
+
+static int parse_fen_square(const char **pp) {
+    const char *p = *pp;
+    int sq = -1;
+    if (isdigit((unsigned char)*p)) {
+        int n = 0;
+        while (isdigit((unsigned char)*p)) n = n * 10 + (*p++ - '0');
+        if (n >= 1 && n <= 32) sq = n - 1;
+    } else if (isalpha((unsigned char)*p)) {
+        char c[3] = { p[0], p[1], '\0' };
+        sq = coord_to_square32(c);
+        p += 2;
+    }
+    *pp = p;
+    return sq;
+}
+
+/* Returns 1 and fills *g on success, 0 on a malformed string. */
+int parse_position(const char *s, GameState *g) {
+    if (!s || !g) return 0;
+    while (isspace((unsigned char)*s)) s++;
+    if (strncmp(s, "startpos", 8) == 0) { init_game(g); return 1; }
+
+    Board32 b = { 0u, 0u, 0u, 0u };
+    char side = (char)toupper((unsigned char)*s++);
+    if (side != 'B' && side != 'W') return 0;
+    while (*s == ':') {
+        s++;
+        char colour = (char)toupper((unsigned char)*s++);
+        if (colour != 'B' && colour != 'W') return 0;
+        while (*s && *s != ':' && !isspace((unsigned char)*s) && *s != '.') {
+            int king = 0;
+            if (*s == ',') { s++; continue; }
+            if (toupper((unsigned char)*s) == 'K') { king = 1; s++; }
+            int lo = parse_fen_square(&s), hi = lo;
+            if (lo < 0) return 0;
+            if (*s == '-') { s++; hi = parse_fen_square(&s); if (hi < lo) return 0; }
+            for (int sq = lo; sq <= hi; ++sq) {
+                unsigned int bit = 1u << sq;
+                if (colour == 'B') { if (king) b.red_king |= bit; else b.red_man |= bit; }
+                else { if (king) b.blk_king |= bit; else b.blk_man |= bit; }
             }
         }
     }
-    return 0;
+    board32_to_gamestate(&b, side == 'B' ? 0 : 1, g);
+    return 1;
 }
 
-int count_red(GameState *g) { return CountBits64(g->red_man) + CountBits64(g->red_king); }
-int count_black(GameState *g) { return CountBits64(g->blk_man) + CountBits64(g->blk_king); }
+static char *format_fen_side(char *p, unsigned int men, unsigned int kings) {
+    int first = 1;
+    for (int sq = 0; sq < 32; ++sq) {
+        unsigned int bit = 1u << sq;
+        if (!((men | kings) & bit)) continue;
+        p += sprintf(p, "%s%s%d", first ? "" : ",", (kings & bit) ? "K" : "", sq + 1);
+        first = 0;
+    }
+    return p;
+}
+
+/* Inverse of parse_position(); out needs POSITION_STR_LEN bytes. */
+void format_position(GameState *g, char *out) {
+    Board32 b;
+    gamestate_to_board32(g, &b);
+    char *p = out;
+    *p++ = (g->turn == 0) ? 'B' : 'W';
+    p += sprintf(p, ":W");
+    p = format_fen_side(p, b.blk_man, b.blk_king);
+    p += sprintf(p, ":B");
+    p = format_fen_side(p, b.red_man, b.red_king);
+    *p = '\0';
+}
+
+/* Parses "b3-c4", "b3xd5xf7", "11-15" or "11x18x25" into the matching
+   legal move of g; a jump chain may also be given by its first and last
+   square only.  s is len characters long and need not be NUL-terminated.
+   Returns 1 on success, 0 if the text is malformed or not legal here. */
+int parse_move_string(GameState *g, const char *s, size_t len, Move *out) {
+    int squares[MAX_JUMPS + 1], n = 0;
+    const char *p = s, *end = s + len;
+    while (p < end) {
+        if (n > MAX_JUMPS) return 0;
+        int sq = parse_fen_square(&p);
+        if (sq < 0 || p > end) return 0;
+        squares[n++] = square32_to_index(sq);
+        if (p == end) break;
+        if (*p != '-' && *p != 'x' && *p != 'X') return 0;
+        if (++p == end) return 0;
+    }
+    if (n < 2) return 0;
+    if (n == 2 && !jumpers_mask(g, g->turn)) {
+        /* No capture anywhere, so only a simple move can match; check it
+           directly instead of listing every move. */
+        int player = g->turn;
+        unsigned long long from = 1ULL << squares[0], to = 1ULL << squares[1];
+        unsigned long long men = (player==0) ? g->red_man : g->blk_man;
+        unsigned long long kings = (player==0) ? g->red_king : g->blk_king;
+        unsigned long long empty = ~all_pieces(g) & DARK_SQUARES;
+        int fwd = (player==0) ? DIR_DR : DIR_UR;
+        for (int d = 0; d < 4; ++d) {
+            unsigned long long pieces = (d == fwd || d == fwd + 1) ? (men | kings) : kings;
+            if (!(shift_dir(from & pieces, d) & to & empty)) continue;
+            memset(out, 0, sizeof(*out));
+            out->from = from;
+            out->to = to;
+            out->from_idx = (unsigned char)squares[0];
+            out->to_idx = (unsigned char)squares[1];
+            out->promote = (men & from) && (to & ((player==0) ? ROW_8_MASK : ROW_1_MASK));
+            return 1;
+        }
+        return 0;
+    }
+    Move moves[MAX_MOVES];
+    int nm = generate_moves(g, g->turn, moves);
+    for (int i = 0; i < nm; ++i) {
+        const Move *m = &moves[i];
+        if (m->from_idx != squares[0] || m->to_idx != squares[n - 1]) continue;
+        if (n > 2) {
+            if (m->njumps != n - 1) continue;
+            int j = 0;
+            while (j < n - 1 && m->path[j] == squares[j + 1]) j++;
+            if (j < n - 1) continue;
+        }
+        *out = *m;
+        return 1;
+    }
+    return 0;
+}
 
 
 int parse_move_input(const char *line, int *from_idx, int *to_idx) {
@@ -420,25 +1325,5716 @@ int parse_move_input(const char *line, int *from_idx, int *to_idx) {
     return 1;
 }
 
-void play_game() {
-    GameState g;
-    init_game(&g);
-    printf("Welcome to BitBoard Checkers (text-mode)!\n");
-    printf("Coordinate system: a-h left->right, 1-8 top->bottom. Example: b3 c4\n");
-    printf("Red pieces (r) start at top (rows 1..3) and move DOWN; Black (b) start bottom and move UP.\n");
-    printf("Kings are R/B. Play alternates turns. Captures are mandatory.\n\n");
+/*
 
-    while (1) {
-        print_board(&g);
-        int red_count = count_red(&g), black_count = count_black(&g);
-        if (red_count == 0) { printf("Black wins! (red has no pieces)\n"); break; }
-        if (black_count == 0) { printf("Red wins! (black has no pieces)\n"); break; }
-        int player = g.turn;
-        if (!player_has_any_move(&g, player)) {
-            if (player == 0) printf("Red has no legal moves. Black wins!\n");
-            else printf("Black has no legal moves. Red wins!\n");
+   Evaluation
+
+   Every term is a weighted popcount of the piece boards against a fixed
+   mask, so the score is exact integer arithmetic.  Scores are from
+   red's point of view in evaluate_red(); evaluate() is relative to the
+   side to move as negamax wants.  The terms are written once, in
+   EVAL_TERMS, over a generic 64-bit lane: evaluate_red() runs it on
+   plain integers and the batch kernels below on vector registers, so
+   the two cannot drift apart.
+
+*/
+
+#define EVAL_MAN          100
+#define EVAL_KING_BONUS    30   /* on top of EVAL_MAN */
+#define EVAL_ADVANCE_1      3   /* man on the middle rows */
+#define EVAL_ADVANCE_2      6   /* man two rows from crowning */
+#define EVAL_BACK_RANK      4   /* man still guarding its king row */
+#define EVAL_CENTER         3
+#define EVAL_MOBILITY       2   /* per piece with a simple move */
+
+#define MIDDLE_ROWS       (0x000000FFFF000000ULL & DARK_SQUARES)   /* rows 4-5 */
+#define RED_ADVANCED      (0x00FFFF0000000000ULL & DARK_SQUARES)   /* rows 6-7 */
+#define BLK_ADVANCED      (0x0000000000FFFF00ULL & DARK_SQUARES)   /* rows 2-3 */
+#define CENTER_SQUARES    (0x0000003C3C000000ULL & DARK_SQUARES)
+
+/* Declares V s = the score of the boards rm, rk, bm, bk (all of type V)
+   on every lane.  down/up are the pieces with an empty square below /
+   above them, i.e. movers_mask() without a GameState.  Lanes are 64-bit
+   and the score stays far inside 32 bits, so MUL need only be a signed
+   32x32->64 multiply and the caller keeps the low 32 bits. */
+#define EVAL_TERMS(V, AND, OR, ANDNOT, SLL, SRL, SET1, POPCNT, SUB, ADD, MUL)                       \
+    V red = OR(rm, rk), blk = OR(bm, bk);                                                          \
+    V empty = ANDNOT(OR(red, blk), SET1(DARK_SQUARES));                                            \
+    V not_a = SET1(~FILE_A_MASK), not_h = SET1(~FILE_H_MASK);                                      \
+    V down = OR(SRL(AND(empty, not_a), BOARD_SIZE + 1), SRL(AND(empty, not_h), BOARD_SIZE - 1));   \
+    V up = OR(SLL(AND(empty, not_a), BOARD_SIZE - 1), SLL(AND(empty, not_h), BOARD_SIZE + 1));     \
+    V s = MUL(SET1(EVAL_MAN), SUB(ADD(POPCNT(rm), POPCNT(rk)), ADD(POPCNT(bm), POPCNT(bk))));       \
+    s = ADD(s, MUL(SET1(EVAL_KING_BONUS), SUB(POPCNT(rk), POPCNT(bk))));                           \
+    s = ADD(s, MUL(SET1(EVAL_ADVANCE_1), SUB(POPCNT(AND(rm, SET1(MIDDLE_ROWS))),                   \
+                                             POPCNT(AND(bm, SET1(MIDDLE_ROWS))))));                \
+    s = ADD(s, MUL(SET1(EVAL_ADVANCE_2), SUB(POPCNT(AND(rm, SET1(RED_ADVANCED))),                  \
+                                             POPCNT(AND(bm, SET1(BLK_ADVANCED))))));               \
+    s = ADD(s, MUL(SET1(EVAL_BACK_RANK), SUB(POPCNT(AND(rm, SET1(ROW_1_MASK))),                    \
+                                             POPCNT(AND(bm, SET1(ROW_8_MASK))))));                 \
+    s = ADD(s, MUL(SET1(EVAL_CENTER), SUB(POPCNT(AND(red, SET1(CENTER_SQUARES))),                  \
+                                          POPCNT(AND(blk, SET1(CENTER_SQUARES))))));               \
+    s = ADD(s, MUL(SET1(EVAL_MOBILITY), SUB(POPCNT(OR(AND(down, red), AND(up, rk))),               \
+                                            POPCNT(OR(AND(up, blk), AND(down, bk))))));
+
+/* The scalar lane: unsigned arithmetic wraps, so the low 32 bits are the score. */
+#define EV_AND(a, b)    ((a) & (b))
+#define EV_OR(a, b)     ((a) | (b))
+#define EV_ANDNOT(a, b) (~(a) & (b))
+#define EV_SLL(a, n)    ((a) << (n))
+#define EV_SRL(a, n)    ((a) >> (n))
+#define EV_SET1(x)      ((unsigned long long)(x))
+#define EV_POPCNT(a)    ((unsigned long long)CountBits64(a))
+#define EV_SUB(a, b)    ((a) - (b))
+#define EV_ADD(a, b)    ((a) + (b))
+#define EV_MUL(a, b)    ((a) * (b))
+
+/* evaluate_red() on bare boards. */
+static inline int evaluate_boards(unsigned long long rm, unsigned long long rk,
+                                  unsigned long long bm, unsigned long long bk) {
+    EVAL_TERMS(unsigned long long, EV_AND, EV_OR, EV_ANDNOT, EV_SLL, EV_SRL, EV_SET1, EV_POPCNT,
+               EV_SUB, EV_ADD, EV_MUL)
+    return (int)(long long)s;
+}
+
+int evaluate_red(GameState *g) {
+    return evaluate_boards(g->red_man, g->red_king, g->blk_man, g->blk_king);
+}
+
+int evaluate(GameState *g) {
+    int score = evaluate_red(g);
+    return (g->turn == 0) ? score : -score;
+}
+
+/*
+
+   Batch evaluation
+
+   evaluate_red_batch() scores n positions given as separate arrays of
+   the four boards (structure of arrays), exactly as evaluate_red() would
+   one at a time.  The vector kernels run the same EVAL_TERMS on 4
+   (AVX2) or 8 (AVX-512) positions per instruction: AVX2 counts bits
+   with the nibble lookup of the bit backends, AVX-512 with VPOPCNTQ.
+   The kernel is picked by CPUID on the first call; evalbench checks
+   every kernel against evaluate_red().
+
+*/
+
+typedef void (*EvalBatchKernel)(const unsigned long long *red_man, const unsigned long long *red_king,
+                                const unsigned long long *blk_man, const unsigned long long *blk_king,
+                                size_t n, int *out);
+
+static void eval_batch_scalar(const unsigned long long *red_man, const unsigned long long *red_king,
+                              const unsigned long long *blk_man, const unsigned long long *blk_king,
+                              size_t n, int *out) {
+    for (size_t i = 0; i < n; ++i) out[i] = evaluate_boards(red_man[i], red_king[i], blk_man[i], blk_king[i]);
+}
+
+#if BITOPS_X86
+#define SET1_256(x) _mm256_set1_epi64x((long long)(x))
+AVX2_TARGET static void eval_batch_avx2(const unsigned long long *red_man, const unsigned long long *red_king,
+                                        const unsigned long long *blk_man, const unsigned long long *blk_king,
+                                        size_t n, int *out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i rm = _mm256_loadu_si256((const __m256i *)(red_man + i));
+        __m256i rk = _mm256_loadu_si256((const __m256i *)(red_king + i));
+        __m256i bm = _mm256_loadu_si256((const __m256i *)(blk_man + i));
+        __m256i bk = _mm256_loadu_si256((const __m256i *)(blk_king + i));
+        EVAL_TERMS(__m256i, _mm256_and_si256, _mm256_or_si256, _mm256_andnot_si256,
+                        _mm256_slli_epi64, _mm256_srli_epi64, SET1_256, popcount256_epi64,
+                        _mm256_sub_epi64, _mm256_add_epi64, _mm256_mul_epi32)
+        /* low dword of every lane -> 4 ints */
+        __m256i packed = _mm256_permutevar8x32_epi32(s, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+        _mm_storeu_si128((__m128i *)(out + i), _mm256_castsi256_si128(packed));
+    }
+    eval_batch_scalar(red_man + i, red_king + i, blk_man + i, blk_king + i, n - i, out + i);
+}
+
+#define SET1_512(x) _mm512_set1_epi64((long long)(x))
+AVX512_TARGET static void eval_batch_avx512(const unsigned long long *red_man, const unsigned long long *red_king,
+                                            const unsigned long long *blk_man, const unsigned long long *blk_king,
+                                            size_t n, int *out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i rm = _mm512_loadu_si512(red_man + i);
+        __m512i rk = _mm512_loadu_si512(red_king + i);
+        __m512i bm = _mm512_loadu_si512(blk_man + i);
+        __m512i bk = _mm512_loadu_si512(blk_king + i);
+        EVAL_TERMS(__m512i, _mm512_and_si512, _mm512_or_si512, _mm512_andnot_si512,
+                        _mm512_slli_epi64, _mm512_srli_epi64, SET1_512, _mm512_popcnt_epi64,
+                        _mm512_sub_epi64, _mm512_add_epi64, _mm512_mul_epi32)
+        _mm256_storeu_si256((__m256i *)(out + i), _mm512_cvtepi64_epi32(s));
+    }
+    eval_batch_scalar(red_man + i, red_king + i, blk_man + i, blk_king + i, n - i, out + i);
+}
+#endif
+
+static const struct { const char *name; EvalBatchKernel fn; } EVAL_KERNELS[] = {
+    { "scalar", eval_batch_scalar },
+#if BITOPS_X86
+    { "avx2", eval_batch_avx2 },
+    { "avx512", eval_batch_avx512 },
+#endif
+};
+#define EVAL_KERNEL_COUNT ((int)(sizeof(EVAL_KERNELS) / sizeof(EVAL_KERNELS[0])))
+
+/* Can this CPU run EVAL_KERNELS[k]? */
+static int eval_kernel_supported(int k) {
+    const char *name = EVAL_KERNELS[k].name;
+#if BITOPS_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    if (strcmp(name, "avx512") == 0) return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+static EvalBatchKernel eval_batch_kernel = eval_batch_scalar;
+static pthread_once_t eval_batch_once = PTHREAD_ONCE_INIT;
+
+static void eval_batch_select(void) {
+    for (int k = 0; k < EVAL_KERNEL_COUNT; ++k)
+        if (eval_kernel_supported(k)) eval_batch_kernel = EVAL_KERNELS[k].fn;
+}
+
+/* out[i] = evaluate_red() of position i, for n positions in SoA form. */
+void evaluate_red_batch(const unsigned long long *red_man, const unsigned long long *red_king,
+                        const unsigned long long *blk_man, const unsigned long long *blk_king,
+                        size_t n, int *out) {
+    pthread_once(&eval_batch_once, eval_batch_select);
+    eval_batch_kernel(red_man, red_king, blk_man, blk_king, n, out);
+}
+
+/*
+
+   NNUE evaluation
+
+   A small quantised network whose first layer is kept up to date
+   incrementally.  Inputs are 128 piece-square features per perspective:
+   (own man, own king, enemy man, enemy king) x 32 playable squares, the
+   board turned round for black so one set of weights serves both sides.
+   The first layer is a 256-wide int16 accumulator per perspective; a
+   move only adds and subtracts the weight rows of the pieces it moves,
+   crowns or captures, so search_make() derives a child's accumulator
+   from its parent's in a few vector adds and unmake is free (one
+   accumulator per ply).  The rest runs at every evaluation:
+
+     x  = clamp(acc[side to move] : acc[other side], 0, 127)   512 x u8
+     h  = clamp((W2 x + b2) >> NNUE_L2_SHIFT, 0, 127)           32 x int8 weights
+     score = (w3 . h + b3) >> NNUE_OUT_SHIFT                    for the side to move
+
+   The weights file is NnueFile as it sits in memory (little-endian) and
+   is mmap'd read-only, so every search thread shares one copy.  Kernels:
+   scalar, and AVX2 with int16 adds for the accumulator and
+   VPMADDUBSW/VPMADDWD dot products for the int8 layer (x <= 127 and
+   |w| <= 128, so the int16 pair sums never saturate and both kernels
+   give identical results).  "nnue gen" writes a random network for
+   testing the format and kernels; "nnue bench" checks incremental
+   against full updates and times them.
+
+*/
+
+#define NNUE_INPUTS    128
+#define NNUE_HIDDEN    256
+#define NNUE_L2        32
+#define NNUE_L2_SHIFT  6
+#define NNUE_OUT_SHIFT 4
+#define NNUE_MAX_DELTA 16        /* rows per update: the mover and up to 12 captures */
+
+typedef struct {
+    char magic[8];               /* "BBCKNNU1" */
+    unsigned int inputs, hidden, l2;   /* must match NNUE_INPUTS/HIDDEN/L2 */
+    unsigned int reserved;
+    unsigned char pad[40];       /* weights start on a 64-byte boundary */
+    short w1[NNUE_INPUTS][NNUE_HIDDEN];
+    short b1[NNUE_HIDDEN];
+    signed char w2[NNUE_L2][2 * NNUE_HIDDEN];
+    int b2[NNUE_L2];
+    int w3[NNUE_L2];
+    int b3;
+} NnueFile;
+
+typedef struct {
+    _Alignas(32) short v[2][NNUE_HIDDEN];   /* [perspective: 0 red, 1 black] */
+} NnueAcc;
+
+typedef void (*NnueUpdateKernel)(const short *in, short *out, const short *const *add, int nadd,
+                                 const short *const *sub, int nsub);
+typedef int (*NnueForwardKernel)(const NnueFile *w, const short *us, const short *them);
+
+typedef struct {
+    const NnueFile *w;           /* the mapped file */
+    size_t size;
+    NnueUpdateKernel update;
+    NnueForwardKernel forward;
+    const char *kernel;
+} NnueNet;
+
+NnueNet *active_nnue = NULL;     /* used by the search when set */
+
+/* Feature row for a piece of color (0 red) on board square idx, seen from persp. */
+static inline int nnue_feature(int persp, int color, int king, int idx) {
+    int sq = __builtin_popcountll(DARK_SQUARES & ((1ULL << idx) - 1));
+    if (persp == 1) sq = 31 - sq;
+    return ((color == persp ? 0 : 2) + king) * 32 + sq;
+}
+
+static void nnue_update_scalar(const short *in, short *out, const short *const *add, int nadd,
+                               const short *const *sub, int nsub) {
+    for (int j = 0; j < NNUE_HIDDEN; ++j) {
+        int v = in[j];
+        for (int a = 0; a < nadd; ++a) v += add[a][j];
+        for (int r = 0; r < nsub; ++r) v -= sub[r][j];
+        out[j] = (short)v;
+    }
+}
+
+/* Output layer on the 32 second-layer sums, shared by the kernels. */
+static int nnue_output(const NnueFile *w, const int *l2) {
+    int out = w->b3;
+    for (int i = 0; i < NNUE_L2; ++i) {
+        int h = l2[i] >> NNUE_L2_SHIFT;
+        h = h < 0 ? 0 : h > 127 ? 127 : h;
+        out += w->w3[i] * h;
+    }
+    return out >> NNUE_OUT_SHIFT;
+}
+
+static int nnue_forward_scalar(const NnueFile *w, const short *us, const short *them) {
+    unsigned char x[2 * NNUE_HIDDEN];
+    for (int j = 0; j < NNUE_HIDDEN; ++j) {
+        x[j] = (unsigned char)(us[j] < 0 ? 0 : us[j] > 127 ? 127 : us[j]);
+        x[NNUE_HIDDEN + j] = (unsigned char)(them[j] < 0 ? 0 : them[j] > 127 ? 127 : them[j]);
+    }
+    int l2[NNUE_L2];
+    for (int i = 0; i < NNUE_L2; ++i) {
+        int sum = w->b2[i];
+        for (int j = 0; j < 2 * NNUE_HIDDEN; ++j) sum += w->w2[i][j] * x[j];
+        l2[i] = sum;
+    }
+    return nnue_output(w, l2);
+}
+
+#if BITOPS_X86
+AVX2_TARGET static void nnue_update_avx2(const short *in, short *out, const short *const *add, int nadd,
+                                         const short *const *sub, int nsub) {
+    for (int j = 0; j < NNUE_HIDDEN; j += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + j));
+        for (int a = 0; a < nadd; ++a) v = _mm256_add_epi16(v, _mm256_loadu_si256((const __m256i *)(add[a] + j)));
+        for (int r = 0; r < nsub; ++r) v = _mm256_sub_epi16(v, _mm256_loadu_si256((const __m256i *)(sub[r] + j)));
+        _mm256_storeu_si256((__m256i *)(out + j), v);
+    }
+}
+
+AVX2_TARGET static int nnue_forward_avx2(const NnueFile *w, const short *us, const short *them) {
+    _Alignas(32) unsigned char x[2 * NNUE_HIDDEN];
+    const __m256i zero = _mm256_setzero_si256();
+    for (int half = 0; half < 2; ++half) {
+        const short *acc = half ? them : us;
+        for (int j = 0; j < NNUE_HIDDEN; j += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(acc + j));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(acc + j + 16));
+            /* saturate to [-128, 127], drop the negatives, undo the lane interleave */
+            __m256i p = _mm256_max_epi8(_mm256_packs_epi16(a, b), zero);
+            _mm256_store_si256((__m256i *)(x + half * NNUE_HIDDEN + j), _mm256_permute4x64_epi64(p, 0xD8));
+        }
+    }
+    /* Four output rows at a time, reduced together with two hadds. */
+    const __m256i ones = _mm256_set1_epi16(1);
+    _Alignas(16) int l2[NNUE_L2];
+    for (int i = 0; i < NNUE_L2; i += 4) {
+        __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+        for (int j = 0; j < 2 * NNUE_HIDDEN; j += 32) {
+            __m256i xv = _mm256_load_si256((const __m256i *)(x + j));
+#define NNUE_DOT(acc, row) acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(xv, \
+                               _mm256_loadu_si256((const __m256i *)(w->w2[row] + j))), ones))
+            NNUE_DOT(s0, i); NNUE_DOT(s1, i + 1); NNUE_DOT(s2, i + 2); NNUE_DOT(s3, i + 3);
+#undef NNUE_DOT
+        }
+        __m256i h = _mm256_hadd_epi32(_mm256_hadd_epi32(s0, s1), _mm256_hadd_epi32(s2, s3));
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i *)(w->b2 + i)));
+        _mm_store_si128((__m128i *)(l2 + i), sum);
+    }
+    return nnue_output(w, l2);
+}
+#endif
+
+static const struct { const char *name; NnueUpdateKernel update; NnueForwardKernel forward; } NNUE_KERNELS[] = {
+    { "scalar", nnue_update_scalar, nnue_forward_scalar },
+#if BITOPS_X86
+    { "avx2", nnue_update_avx2, nnue_forward_avx2 },
+#endif
+};
+#define NNUE_KERNEL_COUNT ((int)(sizeof(NNUE_KERNELS) / sizeof(NNUE_KERNELS[0])))
+
+static int nnue_kernel_supported(int k) {
+#if BITOPS_X86
+    __builtin_cpu_init();
+    if (strcmp(NNUE_KERNELS[k].name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+#endif
+    return strcmp(NNUE_KERNELS[k].name, "scalar") == 0;
+}
+
+/* Maps a weights file; NULL (with a message) if it is missing or not a
+   network of this shape.  Picks the best kernel the CPU supports. */
+NnueNet *nnue_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { printf("Could not open %s\n", path); return NULL; }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == sizeof(NnueFile))
+        map = mmap(NULL, sizeof(NnueFile), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { printf("%s is not a %zu-byte network file\n", path, sizeof(NnueFile)); return NULL; }
+    const NnueFile *w = (const NnueFile *)map;
+    if (memcmp(w->magic, "BBCKNNU1", 8) != 0 || w->inputs != NNUE_INPUTS ||
+        w->hidden != NNUE_HIDDEN || w->l2 != NNUE_L2) {
+        printf("%s: bad magic or layer sizes\n", path);
+        munmap(map, sizeof(NnueFile));
+        return NULL;
+    }
+    NnueNet *net = calloc(1, sizeof(NnueNet));
+    if (!net) { munmap(map, sizeof(NnueFile)); return NULL; }
+    net->w = w;
+    net->size = sizeof(NnueFile);
+    for (int k = 0; k < NNUE_KERNEL_COUNT; ++k) {
+        if (!nnue_kernel_supported(k)) continue;
+        net->update = NNUE_KERNELS[k].update;
+        net->forward = NNUE_KERNELS[k].forward;
+        net->kernel = NNUE_KERNELS[k].name;
+    }
+    return net;
+}
+
+void nnue_close(NnueNet *net) {
+    if (!net) return;
+    munmap((void *)net->w, net->size);
+    free(net);
+}
+
+/* Full recompute of both perspectives from the boards. */
+void nnue_refresh(const NnueNet *net, const GameState *g, NnueAcc *acc) {
+    const unsigned long long boards[4] = { g->red_man, g->red_king, g->blk_man, g->blk_king };
+    for (int p = 0; p < 2; ++p) {
+        const short *rows[32];
+        int n = 0;
+        for (int b = 0; b < 4; ++b) {
+            for (unsigned long long x = boards[b]; x; x &= x - 1)
+                rows[n++] = net->w->w1[nnue_feature(p, b >> 1, b & 1, LowestBit64(x))];
+        }
+        net->update(net->w->b1, acc->v[p], rows, n, NULL, 0);
+    }
+}
+
+/* child = parent after m, which the side to move in g is about to play. */
+void nnue_make(const NnueNet *net, const NnueAcc *parent, NnueAcc *child, const GameState *g, const Move *m) {
+    int me = g->turn;
+    int king = (((me == 0) ? g->red_king : g->blk_king) & m->from) != 0;
+    for (int p = 0; p < 2; ++p) {
+        const short *add[1], *sub[NNUE_MAX_DELTA];
+        int nsub = 0;
+        add[0] = net->w->w1[nnue_feature(p, me, king || m->promote, m->to_idx)];
+        sub[nsub++] = net->w->w1[nnue_feature(p, me, king, m->from_idx)];
+        for (unsigned long long c = m->cap_men; c; c &= c - 1)
+            sub[nsub++] = net->w->w1[nnue_feature(p, 1 - me, 0, LowestBit64(c))];
+        for (unsigned long long c = m->cap_kings; c; c &= c - 1)
+            sub[nsub++] = net->w->w1[nnue_feature(p, 1 - me, 1, LowestBit64(c))];
+        net->update(parent->v[p], child->v[p], add, 1, sub, nsub);
+    }
+}
+
+/* Score for the side to move, kept clear of the win scores. */
+int nnue_evaluate(const NnueNet *net, const NnueAcc *acc, int turn) {
+    int v = net->forward(net->w, acc->v[turn], acc->v[1 - turn]);
+    return v > 20000 ? 20000 : v < -20000 ? -20000 : v;
+}
+
+/* --nnue <file>: loads a network for the search.  Returns the number of
+   argv entries used, or -1 if it cannot be loaded. */
+int parse_nnue_arg(int argc, char **argv) {
+    if (argc < 2 || strcmp(argv[0], "--nnue") != 0) return 0;
+    nnue_close(active_nnue);
+    active_nnue = nnue_open(argv[1]);
+    return active_nnue ? 2 : -1;
+}
+
+/*
+
+   Transposition table
+
+   Power-of-two number of 64-byte buckets, each holding four 16-byte
+   entries, so a probe touches exactly one cache line.  An entry stores
+   (key ^ data, data); a reader accepts it only if the xor gives back
+   its key, so a torn write from another thread just reads as a miss and
+   no locks are needed.  Both words are relaxed atomics (plain moves on
+   x86-64), so the sharing is not a data race.  Replacement prefers the
+   same key, then the shallowest / oldest entry in the bucket.
+
+   data layout: score:16 | depth:8 | bound:2 | age:8 | from:6 | to:6 | has_move:1
+
+*/
+
+#define TT_BUCKET_ENTRIES 4
+#define TT_DEFAULT_MB     16
+
+enum { BOUND_NONE = 0, BOUND_UPPER = 1, BOUND_LOWER = 2, BOUND_EXACT = 3 };
+
+typedef struct {
+    atomic_ullong check;         /* key ^ data */
+    atomic_ullong data;
+} TTEntry;
+
+#define TT_LOAD(field)     atomic_load_explicit(&(field), memory_order_relaxed)
+#define TT_STORE(field, v) atomic_store_explicit(&(field), (v), memory_order_relaxed)
+
+typedef struct {
+    TTEntry e[TT_BUCKET_ENTRIES];
+} __attribute__((aligned(64))) TTBucket;
+
+typedef struct {
+    TTBucket *buckets;
+    unsigned long long mask;     /* bucket count - 1 */
+    size_t bytes;
+    int huge_pages;              /* 1 if MAP_HUGETLB succeeded */
+    unsigned int age;
+} TransTable;
+
+typedef struct {
+    int score;
+    int depth;
+    int bound;
+    int has_move;
+    int from_idx;
+    int to_idx;
+} TTData;
+
+static unsigned long long tt_pack(int score, int depth, int bound, unsigned int age,
+                                  int has_move, int from_idx, int to_idx) {
+    return ((unsigned long long)(unsigned short)(short)score) |
+           ((unsigned long long)(depth & 0xFF) << 16) |
+           ((unsigned long long)(bound & 3) << 24) |
+           ((unsigned long long)(age & 0xFF) << 26) |
+           ((unsigned long long)(from_idx & 63) << 34) |
+           ((unsigned long long)(to_idx & 63) << 40) |
+           ((unsigned long long)(has_move & 1) << 46);
+}
+
+static void tt_unpack(unsigned long long d, TTData *out) {
+    out->score = (short)(unsigned short)(d & 0xFFFF);
+    out->depth = (int)((d >> 16) & 0xFF);
+    out->bound = (int)((d >> 24) & 3);
+    out->from_idx = (int)((d >> 34) & 63);
+    out->to_idx = (int)((d >> 40) & 63);
+    out->has_move = (int)((d >> 46) & 1);
+}
+
+/* Allocates about `mb` megabytes (rounded down to a power of two number
+   of buckets).  Returns 1 on success. */
+int tt_init(TransTable *tt, size_t mb) {
+    memset(tt, 0, sizeof(*tt));
+    size_t want = (mb ? mb : 1) * 1024 * 1024;
+    size_t count = 1;
+    while (count * 2 * sizeof(TTBucket) <= want) count *= 2;
+    tt->bytes = count * sizeof(TTBucket);
+    tt->mask = count - 1;
+
+    void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (tt->bytes >= (2u << 20)) {
+        mem = mmap(NULL, tt->bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) tt->huge_pages = 1;
+    }
+#endif
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, tt->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return 0;
+#ifdef MADV_HUGEPAGE
+        madvise(mem, tt->bytes, MADV_HUGEPAGE);
+#endif
+    }
+    tt->buckets = (TTBucket *)mem;   /* anonymous maps start zeroed */
+    return 1;
+}
+
+void tt_free(TransTable *tt) {
+    if (tt->buckets) munmap(tt->buckets, tt->bytes);
+    tt->buckets = NULL;
+}
+
+void tt_clear(TransTable *tt) {
+    memset(tt->buckets, 0, tt->bytes);
+    tt->age = 0;
+}
+
+/* Called once per search so entries from earlier searches age out. */
+void tt_new_search(TransTable *tt) {
+    tt->age = (tt->age + 1) & 0xFF;
+}
+
+int tt_probe(TransTable *tt, unsigned long long key, TTData *out) {
+    TTBucket *b = &tt->buckets[key & tt->mask];
+    for (int i = 0; i < TT_BUCKET_ENTRIES; ++i) {
+        unsigned long long data = TT_LOAD(b->e[i].data);
+        unsigned long long check = TT_LOAD(b->e[i].check);
+        if ((check ^ data) == key && data) {
+            tt_unpack(data, out);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void tt_store(TransTable *tt, unsigned long long key, int score, int depth, int bound, const Move *m) {
+    TTBucket *b = &tt->buckets[key & tt->mask];
+    TTEntry *victim = &b->e[0];
+    int victim_value = 1 << 30;
+    int has_move = (m != NULL);
+    int from_idx = m ? m->from_idx : 0, to_idx = m ? m->to_idx : 0;
+    for (int i = 0; i < TT_BUCKET_ENTRIES; ++i) {
+        TTEntry *e = &b->e[i];
+        unsigned long long data = TT_LOAD(e->data);
+        if (data && (TT_LOAD(e->check) ^ data) == key) {
+            TTData old;
+            tt_unpack(data, &old);
+            /* Keep a deeper bound from this search over a shallow one. */
+            if (bound != BOUND_EXACT && old.depth > depth + 2 &&
+                ((data >> 26) & 0xFF) == tt->age) return;
+            if (!has_move && old.has_move) {
+                has_move = 1;
+                from_idx = old.from_idx;
+                to_idx = old.to_idx;
+            }
+            victim = e;
+            break;
+        }
+        int age_diff = (int)((tt->age - ((data >> 26) & 0xFF)) & 0xFF);
+        int value = data ? (int)((data >> 16) & 0xFF) - 8 * age_diff : -(1 << 30);
+        if (value < victim_value) { victim_value = value; victim = e; }
+    }
+    unsigned long long d = tt_pack(score, depth, bound, tt->age, has_move, from_idx, to_idx);
+    TT_STORE(victim->data, d);
+    TT_STORE(victim->check, key ^ d);
+}
+
+/* Permille of sampled entries written during the current search. */
+int tt_hashfull(TransTable *tt) {
+    unsigned long long buckets = (tt->mask + 1 < 250) ? tt->mask + 1 : 250;
+    int used = 0, total = 0;
+    for (unsigned long long i = 0; i < buckets; ++i) {
+        for (int j = 0; j < TT_BUCKET_ENTRIES; ++j) {
+            unsigned long long data = TT_LOAD(tt->buckets[i].e[j].data);
+            if (data && ((data >> 26) & 0xFF) == tt->age) used++;
+            total++;
+        }
+    }
+    return total ? used * 1000 / total : 0;
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*
+
+   Endgame tablebases
+
+   A slice is one material signature (red men, red kings, black men,
+   black kings) and holds one byte per position for each side to move:
+     0      draw (or not yet resolved while generating)
+     1..254 resolved, dist = v - 1 plies until the loser has no move;
+            dist even = side to move loses, odd = side to move wins.
+            253 and 254 (dist 252/253) stand for every longer loss/win,
+            so a decided position is never stored as 0
+     255    unused index (a man standing on its own crowning row)
+   Positions are indexed group by group (rm, rk, bm, bk); each group is
+   a colex-ranked subset of the squares the earlier groups left free.
+
+   Generation is retrograde analysis: results are settled in order of
+   distance and propagated to predecessor positions, using slices that
+   are already finished for captures and promotions.  Those only ever
+   lead to slices with fewer pieces or fewer men, so slices with the
+   same piece and man count are independent and are generated in
+   parallel.
+
+   File: header, slice directory, then per slice and side a table of
+   block offsets followed by run-length coded blocks of TB_BLOCK values.
+   The offset tables are not 8-byte aligned and are read with
+   read_u64().  Probing maps the file and keeps recently decoded blocks
+   in a small LRU cache, split into shards with a lock each.
+
+*/
+
+#define TB_MAX_PIECES  8
+#define TB_BLOCK       4096
+#define TB_CACHE_SHARDS 16
+#define TB_CACHE_WAYS   8         /* blocks per shard */
+#define TB_INVALID     255
+#define TB_FAR_DIST    252       /* dist 252/253: a loss/win at least this long */
+
+enum { TB_UNKNOWN = -1, TB_DRAW = 0, TB_WIN = 1, TB_LOSS = 2 };
+
+static unsigned long long BINOM[33][33];
+
+static void init_binomials(void) {
+    if (BINOM[0][0]) return;
+    for (int n = 0; n <= 32; ++n) {
+        BINOM[n][0] = 1ULL;
+        for (int k = 1; k <= n; ++k) BINOM[n][k] = BINOM[n - 1][k - 1] + (k < n ? BINOM[n - 1][k] : 0ULL);
+    }
+}
+
+typedef struct {
+    int count[4];                /* rm, rk, bm, bk */
+    unsigned long long radix[4]; /* subsets of each group */
+    unsigned long long size;
+    unsigned char *val[2];       /* by side to move; generation only */
+} TBSlice;
+
+static unsigned long long tb_rank_group(unsigned int group, unsigned int occ) {
+    unsigned long long r = 0ULL;
+    int i = 1;
+    while (group) {
+        int sq = __builtin_ctz(group);
+        group &= group - 1;
+        int c = sq - __builtin_popcount(occ & ((1u << sq) - 1u));
+        r += BINOM[c][i++];
+    }
+    return r;
+}
+
+static unsigned int tb_unrank_group(unsigned long long r, int k, unsigned int occ) {
+    unsigned int group = 0u;
+    for (int i = k; i >= 1; --i) {
+        int c = i - 1;
+        while (BINOM[c + 1][i] <= r) c++;
+        r -= BINOM[c][i];
+        /* c-th free square */
+        unsigned int free_sq = ~occ;
+        for (int j = 0; j < c; ++j) free_sq &= free_sq - 1;
+        group |= free_sq & (0u - free_sq);
+    }
+    return group;
+}
+
+static void tb_slice_init(TBSlice *sl, int rm, int rk, int bm, int bk) {
+    memset(sl, 0, sizeof(*sl));
+    sl->count[0] = rm; sl->count[1] = rk; sl->count[2] = bm; sl->count[3] = bk;
+    int used = 0;
+    sl->size = 1ULL;
+    for (int g = 0; g < 4; ++g) {
+        sl->radix[g] = BINOM[32 - used][sl->count[g]];
+        sl->size *= sl->radix[g];
+        used += sl->count[g];
+    }
+}
+
+unsigned long long tb_index(const TBSlice *sl, const Board32 *b) {
+    unsigned int groups[4] = { b->red_man, b->red_king, b->blk_man, b->blk_king };
+    unsigned int occ = 0u;
+    unsigned long long idx = 0ULL;
+    for (int g = 0; g < 4; ++g) {
+        idx = idx * sl->radix[g] + tb_rank_group(groups[g], occ);
+        occ |= groups[g];
+    }
+    return idx;
+}
+
+void tb_unindex(const TBSlice *sl, unsigned long long idx, Board32 *b) {
+    unsigned long long digit[4];
+    for (int g = 3; g >= 0; --g) { digit[g] = idx % sl->radix[g]; idx /= sl->radix[g]; }
+    unsigned int groups[4], occ = 0u;
+    for (int g = 0; g < 4; ++g) {
+        groups[g] = tb_unrank_group(digit[g], sl->count[g], occ);
+        occ |= groups[g];
+    }
+    b->red_man = groups[0]; b->red_king = groups[1];
+    b->blk_man = groups[2]; b->blk_king = groups[3];
+}
+
+/* Slices by material, for generation. */
+typedef struct {
+    int max_pieces;
+    int nslices;
+    TBSlice *slices;
+    short lookup[TB_MAX_PIECES + 1][TB_MAX_PIECES + 1][TB_MAX_PIECES + 1][TB_MAX_PIECES + 1];
+} TBSet;
+
+/* Value of child position b with `side` to move, from a finished or
+   in-progress slice.  A side without pieces has lost. */
+static unsigned char tb_child_value(TBSet *set, const Board32 *b, int side) {
+    int c[4] = { __builtin_popcount(b->red_man), __builtin_popcount(b->red_king),
+                 __builtin_popcount(b->blk_man), __builtin_popcount(b->blk_king) };
+    if ((side == 0 && c[0] + c[1] == 0) || (side == 1 && c[2] + c[3] == 0)) return 1;
+    TBSlice *sl = &set->slices[set->lookup[c[0]][c[1]][c[2]][c[3]]];
+    return sl->val[side][tb_index(sl, b)];
+}
+
+typedef struct {
+    TBSet *set;
+    int *wave;                   /* slice numbers of the current wave */
+    int wave_len;
+    atomic_int next;
+} TBWork;
+
+typedef struct {
+    unsigned long long *items;   /* idx*2 + side */
+    size_t len, cap;
+} TBQueue;
+
+/* One queue per distance, grown as longer distances turn up. */
+typedef struct {
+    TBQueue *q;
+    size_t n;
+} TBQueues;
+
+static void tb_push(TBQueues *qs, size_t dist, unsigned long long item) {
+    if (dist >= qs->n) {
+        size_t n = qs->n ? qs->n : 256;
+        while (n <= dist) n *= 2;
+        TBQueue *q = realloc(qs->q, n * sizeof(TBQueue));
+        if (!q) { fprintf(stderr, "tablebase: out of memory\n"); exit(1); }
+        memset(q + qs->n, 0, (n - qs->n) * sizeof(TBQueue));
+        qs->q = q;
+        qs->n = n;
+    }
+    TBQueue *q = &qs->q[dist];
+    if (q->len == q->cap) {
+        q->cap = q->cap ? q->cap * 2 : 1024;
+        q->items = realloc(q->items, q->cap * sizeof(unsigned long long));
+        if (!q->items) { fprintf(stderr, "tablebase: out of memory\n"); exit(1); }
+    }
+    q->items[q->len++] = item;
+}
+
+/* Stored byte for a position decided in dist plies. */
+static unsigned char tb_dist_code(size_t dist) {
+    if (dist >= TB_FAR_DIST) dist = TB_FAR_DIST + (dist & 1);
+    return (unsigned char)(dist + 1);
+}
+
+/* Resolves one slice.  After a pass over every position (terminal
+   positions, moves that leave the slice, and the number of moves that
+   stay inside it), results are settled in order of distance: settling a
+   position walks its in-slice predecessors (reverse simple moves whose
+   origin had no capture available), making them wins at once after a
+   loss, or counting down their remaining moves after a win. */
+static void tb_generate_slice(TBSet *set, TBSlice *sl) {
+    unsigned char *remaining[2];
+    unsigned short *worst[2];
+    for (int side = 0; side < 2; ++side) {
+        sl->val[side] = calloc(sl->size, 1);
+        remaining[side] = calloc(sl->size, 1);   /* unsettled in-slice moves; 255 = can't lose */
+        worst[side] = calloc(sl->size, sizeof(unsigned short));   /* longest win handed to the opponent so far */
+        if (!sl->val[side] || !remaining[side] || !worst[side]) {
+            fprintf(stderr, "tablebase: out of memory\n");
+            exit(1);
+        }
+    }
+    TBQueues queue = { NULL, 0 };
+
+    for (unsigned long long idx = 0; idx < sl->size; ++idx) {
+        Board32 b;
+        tb_unindex(sl, idx, &b);
+        if ((b.red_man & S32_ROW_8) || (b.blk_man & S32_ROW_1)) {
+            sl->val[0][idx] = sl->val[1][idx] = TB_INVALID;
+            continue;
+        }
+        for (int side = 0; side < 2; ++side) {
+            Move32 moves[MAX_MOVES];
+            int n = generate_moves32(&b, side, moves);
+            unsigned long long item = idx * 2 + (unsigned long long)side;
+            if (n == 0) { tb_push(&queue, 0, item); continue; }
+            int inside = 0, can_lose = 1, best_loss = -1, max_win = 0;
+            for (int i = 0; i < n; ++i) {
+                if (!moves[i].njumps && !moves[i].promote) { inside++; continue; }
+                Board32 child = b;
+                apply_move32(&child, side, &moves[i]);
+                unsigned char v = tb_child_value(set, &child, 1 - side);
+                if (v == 0) can_lose = 0;
+                else if (((v - 1) & 1) == 0) { if (best_loss < 0 || v - 1 < best_loss) best_loss = v - 1; }
+                else if (v - 1 > max_win) max_win = v - 1;
+            }
+            if (best_loss >= 0) { tb_push(&queue, (size_t)best_loss + 1, item); can_lose = 0; }
+            remaining[side][idx] = can_lose ? (unsigned char)inside : 255;
+            worst[side][idx] = (unsigned short)max_win;
+            if (can_lose && inside == 0) tb_push(&queue, (size_t)max_win + 1, item);
+        }
+    }
+
+    /* queue.q may move while the queue of distance d is walked, but
+       nothing is pushed at d itself. */
+    for (size_t d = 0; d < queue.n; ++d) {
+        for (size_t q = 0; q < queue.q[d].len; ++q) {
+            unsigned long long item = queue.q[d].items[q];
+            unsigned long long idx = item >> 1;
+            int side = (int)(item & 1ULL);
+            if (sl->val[side][idx]) continue;
+            sl->val[side][idx] = tb_dist_code(d);
+
+            /* Predecessors: the opponent just made a simple move inside the slice. */
+            int opp = 1 - side;
+            Board32 b;
+            tb_unindex(sl, idx, &b);
+            unsigned int occ = b.red_man | b.red_king | b.blk_man | b.blk_king;
+            unsigned int *men = (opp == 0) ? &b.red_man : &b.blk_man;
+            unsigned int *kings = (opp == 0) ? &b.red_king : &b.blk_king;
+            int back = (opp == 0) ? DIR_UR : DIR_DR;    /* men came from behind */
+            for (int kind = 0; kind < 2; ++kind) {
+                unsigned int *set_bits = kind ? kings : men;
+                for (unsigned int pcs = *set_bits; pcs; pcs &= pcs - 1) {
+                    unsigned int to = pcs & (0u - pcs);
+                    for (int dir = 0; dir < 4; ++dir) {
+                        if (!kind && dir != back && dir != back + 1) continue;
+                        unsigned int from = shift32(to, dir) & ~occ;
+                        if (!from) continue;
+                        *set_bits ^= to | from;
+                        if (!jumpers32(&b, opp)) {
+                            unsigned long long pidx = tb_index(sl, &b);
+                            if (!sl->val[opp][pidx]) {
+                                if ((d & 1) == 0) {
+                                    tb_push(&queue, d + 1, pidx * 2 + (unsigned long long)opp);
+                                } else if (remaining[opp][pidx] != 255) {
+                                    if (d > worst[opp][pidx]) worst[opp][pidx] = (unsigned short)(d < 0xFFFF ? d : 0xFFFF);
+                                    if (--remaining[opp][pidx] == 0)
+                                        tb_push(&queue, (size_t)worst[opp][pidx] + 1, pidx * 2 + (unsigned long long)opp);
+                                }
+                            }
+                        }
+                        *set_bits ^= to | from;
+                    }
+                }
+            }
+        }
+        free(queue.q[d].items);
+    }
+    free(queue.q);
+    for (int side = 0; side < 2; ++side) { free(remaining[side]); free(worst[side]); }
+}
+
+static void *tb_worker(void *arg) {
+    TBWork *w = (TBWork *)arg;
+    while (1) {
+        int i = atomic_fetch_add(&w->next, 1);
+        if (i >= w->wave_len) break;
+        tb_generate_slice(w->set, &w->set->slices[w->wave[i]]);
+    }
+    return NULL;
+}
+
+/* Order in which slices can be built: fewer pieces first, then fewer men. */
+static int tb_slice_order(const TBSlice *a) {
+    int pieces = a->count[0] + a->count[1] + a->count[2] + a->count[3];
+    return pieces * 64 + a->count[0] + a->count[2];
+}
+static int tb_cmp_slices(const void *pa, const void *pb) {
+    return tb_slice_order((const TBSlice *)pa) - tb_slice_order((const TBSlice *)pb);
+}
+
+/* Builds every slice with 2..max_pieces pieces (at least one per side). */
+int tb_generate(TBSet *set, int max_pieces, int threads) {
+    init_binomials();
+    memset(set, 0, sizeof(*set));
+    if (max_pieces < 2 || max_pieces > TB_MAX_PIECES) return 0;
+    set->max_pieces = max_pieces;
+    set->slices = calloc(1024, sizeof(TBSlice));
+    if (!set->slices) return 0;
+    for (int rm = 0; rm <= max_pieces; ++rm)
+        for (int rk = 0; rm + rk <= max_pieces; ++rk)
+            for (int bm = 0; rm + rk + bm <= max_pieces; ++bm)
+                for (int bk = 0; rm + rk + bm + bk <= max_pieces; ++bk) {
+                    if (rm + rk == 0 || bm + bk == 0 || rm > 12 || bm > 12) continue;
+                    tb_slice_init(&set->slices[set->nslices++], rm, rk, bm, bk);
+                }
+    qsort(set->slices, (size_t)set->nslices, sizeof(TBSlice), tb_cmp_slices);
+    for (int i = 0; i < set->nslices; ++i) {
+        int *c = set->slices[i].count;
+        set->lookup[c[0]][c[1]][c[2]][c[3]] = (short)i;
+    }
+
+    if (threads < 1) threads = 1;
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    int *wave = calloc(set->nslices > 0 ? (size_t)set->nslices : 1, sizeof(int));
+    for (int start = 0; start < set->nslices; ) {
+        int end = start;
+        int order = tb_slice_order(&set->slices[start]);
+        while (end < set->nslices && tb_slice_order(&set->slices[end]) == order) { wave[end - start] = end; end++; }
+        TBWork w;
+        w.set = set;
+        w.wave = wave;
+        w.wave_len = end - start;
+        atomic_init(&w.next, 0);
+        double t0 = now_seconds();
+        int nt = threads < w.wave_len ? threads : w.wave_len;
+        for (int t = 1; t < nt; ++t) pthread_create(&tids[t], NULL, tb_worker, &w);
+        tb_worker(&w);
+        for (int t = 1; t < nt; ++t) pthread_join(tids[t], NULL);
+        for (int i = start; i < end; ++i) {
+            TBSlice *sl = &set->slices[i];
+            unsigned long long win = 0, loss = 0, draw = 0;
+            for (int side = 0; side < 2; ++side)
+                for (unsigned long long idx = 0; idx < sl->size; ++idx) {
+                    unsigned char v = sl->val[side][idx];
+                    if (v == TB_INVALID) continue;
+                    if (v == 0) draw++;
+                    else if ((v - 1) & 1) win++;
+                    else loss++;
+                }
+            printf("slice r%d+%dK b%d+%dK  %10llu positions  win %10llu loss %10llu draw %10llu\n",
+                   sl->count[0], sl->count[1], sl->count[2], sl->count[3], sl->size * 2, win, loss, draw);
+        }
+        printf("  %d slice(s) in %.2f s\n", w.wave_len, now_seconds() - t0);
+        start = end;
+    }
+    free(wave);
+    free(tids);
+    return 1;
+}
+
+void tb_free_set(TBSet *set) {
+    for (int i = 0; i < set->nslices; ++i) {
+        free(set->slices[i].val[0]);
+        free(set->slices[i].val[1]);
+    }
+    free(set->slices);
+    set->slices = NULL;
+}
+
+typedef struct {
+    char magic[8];
+    unsigned int max_pieces;
+    unsigned int nslices;
+    unsigned int block_size;
+    unsigned int reserved;
+} TBFileHeader;
+
+typedef struct {
+    unsigned char count[4];
+    unsigned int nblocks;
+    unsigned long long size;
+    unsigned long long offsets[2];   /* file position of each side's block offset table */
+} TBFileSlice;
+
+static const char TB_MAGIC[8] = { 'B', 'B', 'C', 'K', 'T', 'B', '0', '1' };
+
+/* Run-length codes n values as (run, value) byte pairs; returns bytes written. */
+static size_t tb_rle_encode(const unsigned char *in, size_t n, unsigned char *out) {
+    size_t o = 0;
+    for (size_t i = 0; i < n; ) {
+        size_t run = 1;
+        while (i + run < n && run < 255 && in[i + run] == in[i]) run++;
+        out[o++] = (unsigned char)run;
+        out[o++] = in[i];
+        i += run;
+    }
+    return o;
+}
+
+/* Unaligned 64-bit load from a mapped file. */
+static inline unsigned long long read_u64(const unsigned char *p) {
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void tb_rle_decode(const unsigned char *in, size_t len, unsigned char *out, size_t n) {
+    size_t o = 0;
+    for (size_t i = 0; i + 1 < len && o < n; i += 2) {
+        size_t run = in[i];
+        if (run > n - o) run = n - o;
+        memset(out + o, in[i + 1], run);
+        o += run;
+    }
+}
+
+int tb_write(TBSet *set, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    TBFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TB_MAGIC, 8);
+    h.max_pieces = (unsigned int)set->max_pieces;
+    h.nslices = (unsigned int)set->nslices;
+    h.block_size = TB_BLOCK;
+    TBFileSlice *dir = calloc((size_t)set->nslices, sizeof(TBFileSlice));
+    unsigned char *buf = malloc(TB_BLOCK * 2);
+    if (!dir || !buf) { fclose(f); free(dir); free(buf); return 0; }
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(dir, sizeof(TBFileSlice), (size_t)set->nslices, f);
+
+    for (int i = 0; i < set->nslices; ++i) {
+        TBSlice *sl = &set->slices[i];
+        unsigned long long nblocks = (sl->size + TB_BLOCK - 1) / TB_BLOCK;
+        for (int g = 0; g < 4; ++g) dir[i].count[g] = (unsigned char)sl->count[g];
+        dir[i].nblocks = (unsigned int)nblocks;
+        dir[i].size = sl->size;
+        unsigned long long *offs = calloc(nblocks + 1, sizeof(unsigned long long));
+        if (!offs) { fclose(f); free(dir); free(buf); return 0; }
+        for (int side = 0; side < 2; ++side) {
+            long table_pos = ftell(f);
+            dir[i].offsets[side] = (unsigned long long)table_pos;
+            fwrite(offs, sizeof(unsigned long long), nblocks + 1, f);   /* placeholder */
+            for (unsigned long long blk = 0; blk < nblocks; ++blk) {
+                unsigned long long first = blk * TB_BLOCK;
+                size_t n = (size_t)((sl->size - first < TB_BLOCK) ? sl->size - first : TB_BLOCK);
+                offs[blk] = (unsigned long long)ftell(f);
+                fwrite(buf, 1, tb_rle_encode(sl->val[side] + first, n, buf), f);
+            }
+            offs[nblocks] = (unsigned long long)ftell(f);
+            long end = ftell(f);
+            fseek(f, table_pos, SEEK_SET);
+            fwrite(offs, sizeof(unsigned long long), nblocks + 1, f);
+            fseek(f, end, SEEK_SET);
+        }
+        free(offs);
+    }
+    fseek(f, (long)sizeof(h), SEEK_SET);
+    fwrite(dir, sizeof(TBFileSlice), (size_t)set->nslices, f);
+    int ok = (ferror(f) == 0);
+    fclose(f);
+    free(dir);
+    free(buf);
+    return ok;
+}
+
+/* A tablebase file opened for probing. */
+typedef struct {
+    unsigned long long tag;      /* slice*2+side + block<<16, 0 = empty */
+    unsigned long long last_used;
+    unsigned char data[TB_BLOCK];
+} TBCacheBlock;
+
+/* A block's shard is picked by its tag, so threads probing different
+   blocks rarely wait on each other. */
+typedef struct {
+    pthread_mutex_t lock;
+    unsigned long long clock;
+    unsigned long long probes, hits;
+    TBCacheBlock block[TB_CACHE_WAYS];
+} TBCacheShard;
+
+typedef struct {
+    unsigned char *map;
+    size_t map_size;
+    int max_pieces;
+    int nslices;
+    TBSlice *slices;             /* geometry only, val[] unused */
+    const TBFileSlice *dir;
+    short lookup[TB_MAX_PIECES + 1][TB_MAX_PIECES + 1][TB_MAX_PIECES + 1][TB_MAX_PIECES + 1];
+    TBCacheShard *cache;
+} TableBase;
+
+TableBase *active_tb = NULL;     /* probed by the search when set */
+
+/* Checks one slice's directory entry and both of its block offset
+   tables against the file, so probing can trust them. */
+static int tb_check_slice(const TableBase *tb, const TBFileSlice *ds) {
+    const unsigned char *c = ds->count;
+    if (c[0] + c[1] + c[2] + c[3] > tb->max_pieces || c[0] + c[1] == 0 || c[2] + c[3] == 0) return 0;
+    TBSlice sl;
+    tb_slice_init(&sl, c[0], c[1], c[2], c[3]);
+    unsigned long long nblocks = (sl.size + TB_BLOCK - 1) / TB_BLOCK;
+    if (ds->size != sl.size || ds->nblocks != nblocks) return 0;
+    for (int side = 0; side < 2; ++side) {
+        unsigned long long table = ds->offsets[side];
+        if (table > tb->map_size || (nblocks + 1) * sizeof(unsigned long long) > tb->map_size - table) return 0;
+        const unsigned char *offs = tb->map + table;
+        unsigned long long prev = table + (nblocks + 1) * sizeof(unsigned long long);
+        for (unsigned long long blk = 0; blk <= nblocks; ++blk) {
+            unsigned long long off = read_u64(offs + blk * sizeof(unsigned long long));
+            if (off < prev || off > tb->map_size) return 0;
+            prev = off;
+        }
+    }
+    return 1;
+}
+
+TableBase *tb_open(const char *path) {
+    init_binomials();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TBFileHeader)) { close(fd); return NULL; }
+    unsigned char *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    TableBase *tb = calloc(1, sizeof(TableBase));
+    if (!tb) { munmap(map, (size_t)st.st_size); return NULL; }
+    tb->map = map;
+    tb->map_size = (size_t)st.st_size;
+    TBFileHeader h;
+    memcpy(&h, map, sizeof(h));
+    int ok = memcmp(h.magic, TB_MAGIC, 8) == 0 && h.max_pieces <= TB_MAX_PIECES && h.block_size == TB_BLOCK &&
+             h.nslices <= (tb->map_size - sizeof(TBFileHeader)) / sizeof(TBFileSlice);
+    if (ok) {
+        tb->max_pieces = (int)h.max_pieces;
+        tb->nslices = (int)h.nslices;
+        tb->dir = (const TBFileSlice *)(map + sizeof(TBFileHeader));
+        tb->slices = calloc(tb->nslices > 0 ? (size_t)tb->nslices : 1, sizeof(TBSlice));
+        tb->cache = calloc(TB_CACHE_SHARDS, sizeof(TBCacheShard));
+        ok = tb->slices && tb->cache;
+    }
+    memset(tb->lookup, 0xFF, sizeof(tb->lookup));
+    for (int i = 0; ok && i < tb->nslices; ++i) {
+        const unsigned char *c = tb->dir[i].count;
+        ok = tb_check_slice(tb, &tb->dir[i]);
+        if (!ok) break;
+        tb_slice_init(&tb->slices[i], c[0], c[1], c[2], c[3]);
+        tb->lookup[c[0]][c[1]][c[2]][c[3]] = (short)i;
+    }
+    if (!ok) {
+        munmap(map, tb->map_size);
+        free(tb->slices);
+        free(tb->cache);
+        free(tb);
+        return NULL;
+    }
+    for (int i = 0; i < TB_CACHE_SHARDS; ++i) pthread_mutex_init(&tb->cache[i].lock, NULL);
+    return tb;
+}
+
+void tb_close(TableBase *tb) {
+    if (!tb) return;
+    munmap(tb->map, tb->map_size);
+    for (int i = 0; i < TB_CACHE_SHARDS; ++i) pthread_mutex_destroy(&tb->cache[i].lock);
+    free(tb->slices);
+    free(tb->cache);
+    free(tb);
+}
+
+/* A miss decodes the block outside the shard lock and installs it
+   afterwards; two threads missing on the same block both decode it. */
+static unsigned char tb_file_value(TableBase *tb, int slice, int side, unsigned long long idx) {
+    unsigned long long blk = idx / TB_BLOCK;
+    unsigned long long tag = ((blk << 16) | (unsigned long long)(slice * 2 + side)) + 1ULL;
+    TBCacheShard *sh = &tb->cache[(tag * 0x9E3779B97F4A7C15ULL) >> 60];
+    unsigned char v;
+    pthread_mutex_lock(&sh->lock);
+    sh->probes++;
+    for (int i = 0; i < TB_CACHE_WAYS; ++i) {
+        TBCacheBlock *c = &sh->block[i];
+        if (c->tag == tag) {
+            c->last_used = ++sh->clock;
+            sh->hits++;
+            v = c->data[idx % TB_BLOCK];
+            pthread_mutex_unlock(&sh->lock);
+            return v;
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    unsigned char data[TB_BLOCK];
+    const unsigned char *offs = tb->map + tb->dir[slice].offsets[side];
+    unsigned long long off = read_u64(offs + blk * sizeof(unsigned long long));
+    unsigned long long end = read_u64(offs + (blk + 1) * sizeof(unsigned long long));
+    unsigned long long first = blk * TB_BLOCK, size = tb->dir[slice].size;
+    size_t n = (size_t)((size - first < TB_BLOCK) ? size - first : TB_BLOCK);
+    memset(data, 0, n);
+    tb_rle_decode(tb->map + off, (size_t)(end - off), data, n);
+    v = data[idx % TB_BLOCK];
+
+    pthread_mutex_lock(&sh->lock);
+    TBCacheBlock *victim = &sh->block[0];
+    for (int i = 0; i < TB_CACHE_WAYS; ++i) {
+        TBCacheBlock *c = &sh->block[i];
+        if (c->tag == tag) { victim = NULL; break; }
+        if (c->last_used < victim->last_used) victim = c;
+    }
+    if (victim) {
+        memcpy(victim->data, data, n);
+        victim->tag = tag;
+        victim->last_used = ++sh->clock;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return v;
+}
+
+/* TB_WIN/TB_LOSS/TB_DRAW for the side to move (TB_UNKNOWN when the
+   material is not in the file); *dist gets the plies to the end, or
+   TB_FAR_DIST/TB_FAR_DIST + 1 for a loss/win at least that long. */
+int tb_probe(TableBase *tb, GameState *g, int *dist) {
+    Board32 b;
+    gamestate_to_board32(g, &b);
+    int c[4] = { __builtin_popcount(b.red_man), __builtin_popcount(b.red_king),
+                 __builtin_popcount(b.blk_man), __builtin_popcount(b.blk_king) };
+    if (c[0] + c[1] + c[2] + c[3] > tb->max_pieces) return TB_UNKNOWN;
+    if (c[0] + c[1] == 0 || c[2] + c[3] == 0) return TB_UNKNOWN;
+    int slice = tb->lookup[c[0]][c[1]][c[2]][c[3]];
+    if (slice < 0) return TB_UNKNOWN;
+    unsigned char v = tb_file_value(tb, slice, g->turn, tb_index(&tb->slices[slice], &b));
+    *dist = 0;
+    if (v == TB_INVALID) return TB_UNKNOWN;
+    if (v == 0) return TB_DRAW;
+    *dist = v - 1;
+    return ((v - 1) & 1) ? TB_WIN : TB_LOSS;
+}
+
+/*
+
+   Search: negamax alpha-beta with iterative deepening
+
+   Aspiration windows around the previous iteration's score, quiescence
+   that keeps playing forced captures before standing pat, and killer +
+   history move ordering.  A search can be bounded by depth, nodes and/or
+   wall time; whatever runs out first stops it.
+
+*/
+
+#define MAX_PLY        64
+#define SCORE_INF      32000
+#define SCORE_WIN      30000     /* side to move wins in n plies: SCORE_WIN - n */
+#define SCORE_WIN_MIN  (SCORE_WIN - 512)   /* covers tablebase distances */
+#define ASPIRATION     25
+
+/* Win scores are stored relative to the node, not the root. */
+static int score_to_tt(int score, int ply) {
+    if (score >= SCORE_WIN_MIN) return score + ply;
+    if (score <= -SCORE_WIN_MIN) return score - ply;
+    return score;
+}
+static int score_from_tt(int score, int ply) {
+    if (score >= SCORE_WIN_MIN) return score - ply;
+    if (score <= -SCORE_WIN_MIN) return score + ply;
+    return score;
+}
+
+typedef struct {
+    int depth;                   /* 0 = no limit */
+    unsigned long long nodes;    /* 0 = no limit */
+    int movetime_ms;             /* 0 = no limit */
+    int threads;                 /* Lazy SMP threads; 0/1 = single-threaded */
+    atomic_int *stop_flag;       /* set non-zero from outside to stop; may be NULL */
+    atomic_int *ponder;          /* non-zero while pondering: no node or time budget
+                                    until it is cleared (ponder hit); may be NULL */
+    const Move *exclude;         /* root moves left out (multi-PV); may be NULL */
+    int nexclude;
+} SearchLimits;
+
+/* Initialiser for every SearchLimits: no limits, one thread.  Callers
+   set the fields they need afterwards, so new fields start out zero. */
+#define SEARCH_LIMITS_DEFAULT { .threads = 1 }
+
+/* Search counters, kept per thread in plain fields and summed with
+   search_stats_add() when asked for.  Build with -DSEARCH_STATS=0 to
+   compile them out.  Cycle counts around move generation and evaluation
+   cost about a quarter of the search speed, so they are only compiled
+   in with -DSEARCH_STATS_TIMING=1. */
+#ifndef SEARCH_STATS
+#define SEARCH_STATS 1
+#endif
+#ifndef SEARCH_STATS_TIMING
+#define SEARCH_STATS_TIMING 0
+#endif
+
+typedef struct {
+    unsigned long long nodes;            /* negamax nodes */
+    unsigned long long qnodes;           /* quiescence nodes */
+    unsigned long long movegen_calls;
+    unsigned long long evals;
+    unsigned long long tt_cutoffs;
+    unsigned long long beta_cutoffs;
+    unsigned long long first_move_cutoffs;
+    unsigned long long movegen_cycles;   /* TSC cycles, 0 unless SEARCH_STATS_TIMING */
+    unsigned long long eval_cycles;
+} SearchStats;
+
+#if SEARCH_STATS
+#define STAT_INC(s, field) ((s)->stats.field++)
+#else
+#define STAT_INC(s, field) ((void)0)
+#endif
+
+#if SEARCH_STATS && SEARCH_STATS_TIMING && BITOPS_X86
+#define STAT_TIME(s, field, stmt) do {                          \
+        unsigned long long stat_t0_ = __rdtsc();                  \
+        stmt;                                                     \
+        (s)->stats.field += __rdtsc() - stat_t0_;                 \
+    } while (0)
+#else
+#define STAT_TIME(s, field, stmt) do { stmt; } while (0)
+#endif
+
+void search_stats_add(SearchStats *to, const SearchStats *from) {
+    to->nodes += from->nodes;
+    to->qnodes += from->qnodes;
+    to->movegen_calls += from->movegen_calls;
+    to->evals += from->evals;
+    to->tt_cutoffs += from->tt_cutoffs;
+    to->beta_cutoffs += from->beta_cutoffs;
+    to->first_move_cutoffs += from->first_move_cutoffs;
+    to->movegen_cycles += from->movegen_cycles;
+    to->eval_cycles += from->eval_cycles;
+}
+
+/* tt_probes, tt_hits and stats cover the main thread while the
+   iterations are printed and every thread once search_position()
+   returns. */
+typedef struct {
+    Move best;
+    int has_move;
+    int score;
+    int depth;                   /* last completed iteration */
+    unsigned long long nodes;
+    double seconds;
+    Move pv[MAX_PLY];
+    int pv_len;
+    unsigned long long tt_probes;
+    unsigned long long tt_hits;
+    int hashfull;                /* permille, 0 without a table */
+    unsigned long long tb_hits;
+    SearchStats stats;           /* per iteration (main thread); totals at the end */
+} SearchResult;
+
+/* Shared by every thread of one search; everything else is per thread. */
+typedef struct {
+    atomic_int stop;
+    atomic_ullong nodes;
+} SharedSearch;
+
+typedef struct {
+    SearchLimits limits;
+    SharedSearch *shared;
+    int thread_id;               /* 0 = main thread */
+    unsigned long long nodes_flushed;
+    double start;
+    double deadline;             /* 0 = none */
+    int pondering;               /* budget not started yet, see SearchLimits.ponder */
+    unsigned long long budget_nodes;  /* shared node count when the budget started */
+    unsigned long long nodes;
+    int stop;
+    int verbose;
+    Move killers[MAX_PLY][2];
+    int history[2][BOARD_SQUARES][BOARD_SQUARES];
+    Move pv[MAX_PLY][MAX_PLY];
+    int pv_len[MAX_PLY];
+    Undo undo[MAX_PLY];          /* make/unmake stack, by ply */
+    Move prev_best;              /* searched first at the root */
+    int has_prev_best;
+    TransTable *tt;              /* may be NULL */
+    unsigned long long tt_probes;
+    unsigned long long tt_hits;
+    unsigned long long tb_hits;
+    SearchStats stats;
+    NnueAcc acc[MAX_PLY + 1];    /* by ply, while active_nnue is set */
+} Searcher;
+
+int same_move(const Move *a, const Move *b) {
+    return a->from == b->from && a->to == b->to &&
+           a->cap_men == b->cap_men && a->cap_kings == b->cap_kings;
+}
+
+/* Every 1024 nodes: publish this thread's node count, pick up a stop
+   from another thread or the caller's stop_flag and check the
+   node/time budget.  A ponder search has no budget until the ponder
+   flag is cleared; from then on it gets the normal one, as if it had
+   just been started. */
+static void check_limits(Searcher *s) {
+    if (s->nodes & 1023) return;
+    unsigned long long delta = s->nodes - s->nodes_flushed;
+    unsigned long long total = atomic_fetch_add_explicit(&s->shared->nodes, delta, memory_order_relaxed) + delta;
+    s->nodes_flushed = s->nodes;
+    if (atomic_load_explicit(&s->shared->stop, memory_order_relaxed)) s->stop = 1;
+    if (s->limits.stop_flag && atomic_load_explicit(s->limits.stop_flag, memory_order_relaxed)) s->stop = 1;
+    if (s->pondering) {
+        if (atomic_load_explicit(s->limits.ponder, memory_order_relaxed)) return;
+        s->pondering = 0;
+        s->budget_nodes = total;
+        if (s->limits.movetime_ms > 0) s->deadline = now_seconds() + s->limits.movetime_ms / 1000.0;
+    }
+    if (s->limits.nodes && total - s->budget_nodes >= s->limits.nodes) s->stop = 1;
+    if (s->deadline > 0 && now_seconds() >= s->deadline) s->stop = 1;
+}
+
+/* Sort moves by descending ordering score (lists are short). */
+/* hint_from/hint_to: squares of the hash or previous-iteration move, -1 if none. */
+static void order_moves(Searcher *s, GameState *g, Move *moves, int n, int ply, int hint_from, int hint_to) {
+    int keys[MAX_MOVES];
+    for (int i = 0; i < n; ++i) {
+        Move *m = &moves[i];
+        int k;
+        if (m->from_idx == hint_from && m->to_idx == hint_to) k = 1 << 30;
+        else if (m->njumps) k = (1 << 24) + 256 * m->njumps + 64 * CountBits64(m->cap_kings);
+        else if (same_move(m, &s->killers[ply][0])) k = (1 << 23);
+        else if (same_move(m, &s->killers[ply][1])) k = (1 << 22);
+        else k = s->history[g->turn][m->from_idx][m->to_idx];
+        if (m->promote) k += 1 << 21;
+        keys[i] = k;
+    }
+    for (int i = 1; i < n; ++i) {
+        Move m = moves[i];
+        int k = keys[i], j = i - 1;
+        while (j >= 0 && keys[j] < k) { moves[j + 1] = moves[j]; keys[j + 1] = keys[j]; --j; }
+        moves[j + 1] = m;
+        keys[j + 1] = k;
+    }
+}
+
+/* Drops the root moves listed in limits->exclude; returns the new count. */
+static int drop_excluded(Move *moves, int n, const SearchLimits *limits) {
+    int kept = 0;
+    for (int i = 0; i < n; ++i) {
+        int skip = 0;
+        for (int j = 0; j < limits->nexclude && !skip; ++j) skip = same_move(&moves[i], &limits->exclude[j]);
+        if (!skip) moves[kept++] = moves[i];
+    }
+    return kept;
+}
+
+/* Static evaluation at a leaf: the network when one is loaded, else evaluate(). */
+static int search_evaluate(Searcher *s, GameState *g, int ply) {
+    int v;
+    STAT_INC(s, evals);
+    if (active_nnue) STAT_TIME(s, eval_cycles, v = nnue_evaluate(active_nnue, &s->acc[ply], g->turn));
+    else STAT_TIME(s, eval_cycles, v = evaluate(g));
+    return v;
+}
+
+/* make_move() into s->undo[ply], plus the accumulator for ply + 1 when
+   a network is loaded.  Unmaking needs nothing more than unmake_move(). */
+static inline void search_make(Searcher *s, GameState *g, const Move *m, int ply) {
+    if (active_nnue) nnue_make(active_nnue, &s->acc[ply], &s->acc[ply + 1], g, m);
+    make_move(g, m, &s->undo[ply]);
+}
+
+/* Captures are mandatory, so a side that can jump may not stand pat. */
+static int quiesce(Searcher *s, GameState *g, int alpha, int beta, int ply) {
+    s->nodes++;
+    STAT_INC(s, qnodes);
+    check_limits(s);
+    if (s->stop) return 0;
+
+    Move moves[MAX_MOVES];
+    int n;
+    STAT_INC(s, movegen_calls);
+    STAT_TIME(s, movegen_cycles, n = generate_captures(g, g->turn, moves));
+    if (n == 0) {
+        int has_move;
+        STAT_TIME(s, movegen_cycles, has_move = player_has_any_move(g, g->turn));
+        if (!has_move) return -SCORE_WIN + ply;
+        return search_evaluate(s, g, ply);
+    }
+    if (ply >= MAX_PLY - 1) return search_evaluate(s, g, ply);
+    order_moves(s, g, moves, n, ply, -1, -1);
+    for (int i = 0; i < n; ++i) {
+        search_make(s, g, &moves[i], ply);
+        int score = -quiesce(s, g, -beta, -alpha, ply + 1);
+        unmake_move(g, &s->undo[ply]);
+        if (s->stop) return 0;
+        if (score > alpha) {
+            alpha = score;
+            if (alpha >= beta) break;
+        }
+    }
+    return alpha;
+}
+
+static int negamax(Searcher *s, GameState *g, int depth, int alpha, int beta, int ply) {
+    s->pv_len[ply] = 0;
+    if (depth <= 0 || ply >= MAX_PLY - 1) return quiesce(s, g, alpha, beta, ply);
+
+    s->nodes++;
+    STAT_INC(s, nodes);
+    check_limits(s);
+    if (s->stop) return 0;
+
+    if (active_tb && ply > 0 && CountBits64(all_pieces(g)) <= active_tb->max_pieces) {
+        int dist;
+        int r = tb_probe(active_tb, g, &dist);
+        if (r != TB_UNKNOWN) {
+            s->tb_hits++;
+            if (r == TB_WIN) return SCORE_WIN - ply - dist;
+            if (r == TB_LOSS) return -SCORE_WIN + ply + dist;
+            return 0;
+        }
+    }
+
+    int hint_from = -1, hint_to = -1;
+    if (s->tt) {
+        TTData hit;
+        s->tt_probes++;
+        if (tt_probe(s->tt, g->key, &hit)) {
+            s->tt_hits++;
+            if (hit.has_move) { hint_from = hit.from_idx; hint_to = hit.to_idx; }
+            if (ply > 0 && hit.depth >= depth) {
+                int v = score_from_tt(hit.score, ply);
+                if (hit.bound == BOUND_EXACT ||
+                    (hit.bound == BOUND_LOWER && v >= beta) ||
+                    (hit.bound == BOUND_UPPER && v <= alpha)) {
+                    STAT_INC(s, tt_cutoffs);
+                    return v;
+                }
+            }
+        }
+    }
+
+    Move moves[MAX_MOVES];
+    int n;
+    STAT_INC(s, movegen_calls);
+    STAT_TIME(s, movegen_cycles, n = generate_moves(g, g->turn, moves));
+    if (n == 0) return -SCORE_WIN + ply;
+    if (ply == 0 && s->limits.nexclude) n = drop_excluded(moves, n, &s->limits);
+
+    if (ply == 0 && s->has_prev_best) { hint_from = s->prev_best.from_idx; hint_to = s->prev_best.to_idx; }
+    order_moves(s, g, moves, n, ply, hint_from, hint_to);
+
+    int alpha_orig = alpha;
+    int best = -SCORE_INF;
+    int best_i = 0;
+    for (int i = 0; i < n; ++i) {
+        search_make(s, g, &moves[i], ply);
+        int score;
+        if (i == 0) {
+            score = -negamax(s, g, depth - 1, -beta, -alpha, ply + 1);
+        } else {
+            score = -negamax(s, g, depth - 1, -alpha - 1, -alpha, ply + 1);
+            if (score > alpha && score < beta && !s->stop)
+                score = -negamax(s, g, depth - 1, -beta, -alpha, ply + 1);
+        }
+        unmake_move(g, &s->undo[ply]);
+        if (s->stop) return 0;
+        if (score > best) { best = score; best_i = i; }
+        if (score > alpha) {
+            alpha = score;
+            s->pv[ply][0] = moves[i];
+            memcpy(&s->pv[ply][1], &s->pv[ply + 1][0], sizeof(Move) * s->pv_len[ply + 1]);
+            s->pv_len[ply] = s->pv_len[ply + 1] + 1;
+        }
+        if (alpha >= beta) {
+            STAT_INC(s, beta_cutoffs);
+            if (i == 0) STAT_INC(s, first_move_cutoffs);
+            if (!moves[i].njumps) {
+                if (!same_move(&moves[i], &s->killers[ply][0])) {
+                    s->killers[ply][1] = s->killers[ply][0];
+                    s->killers[ply][0] = moves[i];
+                }
+                int *h = &s->history[g->turn][moves[i].from_idx][moves[i].to_idx];
+                *h += depth * depth;
+                if (*h > (1 << 20)) {
+                    for (int p = 0; p < 2; ++p)
+                        for (int f = 0; f < BOARD_SQUARES; ++f)
+                            for (int t = 0; t < BOARD_SQUARES; ++t) s->history[p][f][t] /= 2;
+                }
+            }
+            break;
+        }
+    }
+    if (s->tt && !(ply == 0 && s->limits.nexclude)) {
+        int bound = (best >= beta) ? BOUND_LOWER : (best > alpha_orig) ? BOUND_EXACT : BOUND_UPPER;
+        tt_store(s->tt, g->key, score_to_tt(best, ply), depth, bound, &moves[best_i]);
+    }
+    return best;
+}
+
+void print_search_line(const SearchResult *r) {
+    printf("depth %2d score %6d nodes %10llu time %7.3f nps %9.0f hashfull %4d hits %5.1f%% pv",
+           r->depth, r->score, r->nodes, r->seconds,
+           r->seconds > 0 ? (double)r->nodes / r->seconds : 0.0, r->hashfull,
+           r->tt_probes ? 100.0 * (double)r->tt_hits / (double)r->tt_probes : 0.0);
+    for (int i = 0; i < r->pv_len; ++i) {
+        char buf[MOVE_STR_LEN];
+        move_to_string(&r->pv[i], buf);
+        printf(" %s", buf);
+    }
+    printf("\n");
+}
+
+/* One JSON object per line: the search line's fields plus SearchStats. */
+void print_stats_json(const SearchResult *r, const char *kind) {
+    const SearchStats *st = &r->stats;
+    printf("{\"type\":\"%s\",\"depth\":%d,\"score\":%d,\"nodes\":%llu,\"time\":%.6f,\"nps\":%.0f,"
+           "\"hashfull\":%d,\"negamax_nodes\":%llu,\"qnodes\":%llu,\"movegen_calls\":%llu,\"evals\":%llu,"
+           "\"tt_probes\":%llu,\"tt_hits\":%llu,\"tt_cutoffs\":%llu,\"beta_cutoffs\":%llu,"
+           "\"first_move_cutoffs\":%llu,\"first_move_cutoff_rate\":%.4f,"
+           "\"movegen_cycles\":%llu,\"eval_cycles\":%llu,\"stats_enabled\":%d,\"pv\":\"",
+           kind, r->depth, r->score, r->nodes, r->seconds,
+           r->seconds > 0 ? (double)r->nodes / r->seconds : 0.0, r->hashfull,
+           st->nodes, st->qnodes, st->movegen_calls, st->evals,
+           r->tt_probes, r->tt_hits, st->tt_cutoffs, st->beta_cutoffs, st->first_move_cutoffs,
+           st->beta_cutoffs ? (double)st->first_move_cutoffs / (double)st->beta_cutoffs : 0.0,
+           st->movegen_cycles, st->eval_cycles, SEARCH_STATS);
+    for (int i = 0; i < r->pv_len; ++i) {
+        char buf[MOVE_STR_LEN];
+        move_to_string(&r->pv[i], buf);
+        printf("%s%s", i ? " " : "", buf);
+    }
+    printf("\"}\n");
+    fflush(stdout);
+}
+
+static unsigned long long shared_nodes(Searcher *s) {
+    return atomic_load_explicit(&s->shared->nodes, memory_order_relaxed) + (s->nodes - s->nodes_flushed);
+}
+
+/* One thread's iterative deepening loop.  Helper threads (thread_id > 0)
+   search odd ids one ply deeper so the threads spread over more of the
+   tree; they only feed the shared hash table and stop when the main
+   thread does. */
+static void iterative_deepening(Searcher *s, GameState *g, int nroot, SearchResult *out, int verbose) {
+    int is_main = (s->thread_id == 0);
+    if (active_nnue) nnue_refresh(active_nnue, g, &s->acc[0]);
+    int max_depth = (s->limits.depth > 0 && s->limits.depth < MAX_PLY - 1) ? s->limits.depth : MAX_PLY - 2;
+    int score = 0;
+    for (int iter = 1; iter <= max_depth; ++iter) {
+        int depth = is_main ? iter : iter + (s->thread_id & 1);
+        int delta = ASPIRATION;
+        int alpha = -SCORE_INF, beta = SCORE_INF;
+        if (iter >= 3) { alpha = score - delta; beta = score + delta; }
+        while (1) {
+            s->pv_len[0] = 0;
+            int v = negamax(s, g, depth, alpha, beta, 0);
+            if (s->stop) break;
+            if (v <= alpha) { alpha = (v - delta < -SCORE_INF) ? -SCORE_INF : v - delta; delta *= 2; continue; }
+            if (v >= beta) { beta = (v + delta > SCORE_INF) ? SCORE_INF : v + delta; delta *= 2; continue; }
+            score = v;
+            break;
+        }
+        if (s->stop && iter > 1) break;
+        if (s->pv_len[0] > 0) {
+            out->best = s->pv[0][0];
+            s->prev_best = out->best;
+            s->has_prev_best = 1;
+            out->pv_len = s->pv_len[0];
+            memcpy(out->pv, s->pv[0], sizeof(Move) * s->pv_len[0]);
+        }
+        out->score = score;
+        out->depth = depth;
+        if (!is_main) {
+            if (s->stop) break;
+            continue;
+        }
+        out->nodes = shared_nodes(s);
+        out->seconds = now_seconds() - s->start;
+        out->tt_probes = s->tt_probes;
+        out->tt_hits = s->tt_hits;
+        out->stats = s->stats;
+        if (verbose) {
+            if (s->tt) out->hashfull = tt_hashfull(s->tt);
+            if (verbose == 3) {
+                print_stats_json(out, "iteration");
+            } else {
+                if (verbose > 1) printf("info ");
+                print_search_line(out);
+                if (verbose > 1) fflush(stdout);
+            }
+        }
+        if (s->stop) break;
+        if (nroot == 1 && s->limits.depth == 0) break;
+        if (score >= SCORE_WIN_MIN || score <= -SCORE_WIN_MIN) break;
+        /* The next iteration would not finish inside the time budget. */
+        if (s->deadline > 0 && out->seconds > 0.5 * (s->deadline - s->start)) break;
+    }
+}
+
+typedef struct {
+    Searcher *s;
+    GameState root;
+    int nroot;
+    SearchResult result;
+    pthread_t thread;
+} SearchThread;
+
+static void *search_thread_main(void *arg) {
+    SearchThread *t = (SearchThread *)arg;
+    iterative_deepening(t->s, &t->root, t->nroot, &t->result, 0);
+    return NULL;
+}
+
+/* Each thread gets its own cache-line aligned Searcher (stack, killers,
+   history), so threads only ever share the hash table and SharedSearch. */
+static Searcher *new_searcher(const SearchLimits *limits, SharedSearch *shared, TransTable *tt,
+                              int thread_id, double start) {
+    size_t size = (sizeof(Searcher) + 63) & ~(size_t)63;
+    Searcher *s = aligned_alloc(64, size);
+    if (!s) return NULL;
+    memset(s, 0, size);
+    s->limits = *limits;
+    s->shared = shared;
+    s->thread_id = thread_id;
+    s->tt = tt;
+    s->start = start;
+    s->pondering = limits->ponder && atomic_load(limits->ponder);
+    s->deadline = (limits->movetime_ms > 0 && !s->pondering) ? start + limits->movetime_ms / 1000.0 : 0.0;
+    return s;
+}
+
+/* Iterative deepening driver.  out->best is the best move of the last
+   completed iteration (or of the first iteration if even that was cut
+   short); out->has_move is 0 when the side to move has no legal move.
+   verbose: 0 = quiet, 1 = print every iteration, 2 = print them as
+   protocol "info" lines, 3 = print them as JSON.  out->stats and
+   out->tt_probes/tt_hits have every thread's counters summed.  tt may
+   be NULL to search without a transposition table.  With
+   limits->threads > 1 the extra threads run Lazy SMP on the same root
+   and share only tt; the main thread's result is reported and nodes
+   are summed over all threads.  Root moves in limits->exclude are not
+   searched; out->has_move is 0 when that leaves none. */
+void search_position(GameState *pos, const SearchLimits *limits, TransTable *tt,
+                     SearchResult *out, int verbose) {
+    memset(out, 0, sizeof(*out));
+    GameState root = *pos;
+    GameState *g = &root;
+    g->key = compute_key(g);     /* moves made through execute_move() don't track it */
+    Move root_moves[MAX_MOVES];
+    int nroot = generate_moves(g, g->turn, root_moves);
+    if (nroot == 0) { out->score = -SCORE_WIN; return; }
+    if (limits->nexclude && (nroot = drop_excluded(root_moves, nroot, limits)) == 0) return;
+    out->best = root_moves[0];
+    out->has_move = 1;
+
+    SharedSearch shared;
+    atomic_init(&shared.stop, 0);
+    atomic_init(&shared.nodes, 0ULL);
+    double start = now_seconds();
+    if (tt) tt_new_search(tt);
+    Searcher *s = new_searcher(limits, &shared, tt, 0, start);
+    if (!s) return;
+
+    int nthreads = limits->threads > 1 ? limits->threads : 1;
+    SearchThread *helpers = NULL;
+    int started = 0;
+    if (nthreads > 1) {
+        helpers = calloc((size_t)nthreads - 1, sizeof(SearchThread));
+        for (int i = 0; helpers && i < nthreads - 1; ++i) {
+            SearchThread *t = &helpers[i];
+            t->s = new_searcher(limits, &shared, tt, i + 1, start);
+            t->root = root;
+            t->nroot = nroot;
+            if (!t->s) break;
+            if (pthread_create(&t->thread, NULL, search_thread_main, t) != 0) { free(t->s); break; }
+            started++;
+        }
+    }
+
+    iterative_deepening(s, g, nroot, out, verbose);
+
+    atomic_store(&shared.stop, 1);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(helpers[i].thread, NULL);
+        atomic_fetch_add(&shared.nodes, helpers[i].s->nodes - helpers[i].s->nodes_flushed);
+        search_stats_add(&s->stats, &helpers[i].s->stats);
+        s->tt_probes += helpers[i].s->tt_probes;
+        s->tt_hits += helpers[i].s->tt_hits;
+        free(helpers[i].s);
+    }
+    free(helpers);
+    atomic_fetch_add(&shared.nodes, s->nodes - s->nodes_flushed);
+    out->nodes = atomic_load(&shared.nodes);
+    out->seconds = now_seconds() - start;
+    out->tt_probes = s->tt_probes;
+    out->tt_hits = s->tt_hits;
+    out->tb_hits = s->tb_hits;
+    out->stats = s->stats;
+    if (tt) out->hashfull = tt_hashfull(tt);
+    free(s);
+}
+
+/* --tb <file>: opens a tablebase for the search to probe.  Returns the
+   number of argv entries used, or -1 if the file cannot be opened. */
+int parse_tb_arg(int argc, char **argv) {
+    if (argc < 2 || strcmp(argv[0], "--tb") != 0) return 0;
+    tb_close(active_tb);
+    active_tb = tb_open(argv[1]);
+    if (!active_tb) { printf("Could not open tablebase %s\n", argv[1]); return -1; }
+    return 2;
+}
+
+/* Parses --depth/--nodes/--time/--threads; returns how many argv
+   entries it used (0 when argv[0] is not a limit option). */
+int parse_limit_arg(int argc, char **argv, SearchLimits *limits) {
+    if (argc < 2) return 0;
+    if (strcmp(argv[0], "--depth") == 0) { limits->depth = atoi(argv[1]); return 2; }
+    if (strcmp(argv[0], "--nodes") == 0) { limits->nodes = strtoull(argv[1], NULL, 10); return 2; }
+    if (strcmp(argv[0], "--time") == 0) { limits->movetime_ms = atoi(argv[1]); return 2; }
+    if (strcmp(argv[0], "--threads") == 0) { limits->threads = atoi(argv[1]); return 2; }
+    return 0;
+}
+
+/* Fixed suite for the SMP benchmark: quiet middlegame positions. */
+static const char *SMP_BENCH_POSITIONS[] = {
+    "startpos",
+    "B:W17,19,21,22,24,25,28,29,30,31,32:B1,2,3,4,5,6,10,12,14,15,18",
+    "B:W19,21,23,24,27,28,29,30,31:B1,2,3,4,7,11,12,14,20",
+    "B:W19,23,25,27,30,31,32:B1,3,4,5,7,12,13,17",
+    "B:W19,21,22,24,26,29,30:B2,3,4,6,12,13,14",
+    "B:W19,22,29,30,31,32:B2,8,10,11,12,21",
+    "B:W17,19,20,21,22,23,25,26:B3,8,9,10,11,12,13,14",
+    "B:WK3,19,20,21,29,30:B1,5,7,9,11,K32",
+    "B:W9,10,14,17,27,28:B1,2,4,5,19,20,K30",
+};
+#define SMP_BENCH_COUNT ((int)(sizeof(SMP_BENCH_POSITIONS) / sizeof(SMP_BENCH_POSITIONS[0])))
+
+/* Time-to-depth over the suite for 1, 2, 4, ... max_threads threads.
+   The hash table is cleared before every position. */
+int smpbench_main(int argc, char **argv) {
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int depth = 14;
+    size_t hash_mb = 64;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) hash_mb = (size_t)atoi(argv[++i]);
+        else max_threads = atoi(argv[i]);
+    }
+    if (max_threads < 1) max_threads = 1;
+    TransTable tt;
+    if (!tt_init(&tt, hash_mb)) { printf("Could not allocate %zu MB hash.\n", hash_mb); return 1; }
+
+    printf("SMP benchmark: %d positions, depth %d, hash %zu MB\n", SMP_BENCH_COUNT, depth, hash_mb);
+    printf("threads      time(s)          nodes          nps   speedup  nps-scale\n");
+    double base_time = 0.0, base_nps = 0.0;
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > max_threads) threads = max_threads;
+        SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+        limits.depth = depth;
+        limits.threads = threads;
+        double secs = 0.0;
+        unsigned long long nodes = 0ULL;
+        for (int i = 0; i < SMP_BENCH_COUNT; ++i) {
+            GameState g;
+            parse_position(SMP_BENCH_POSITIONS[i], &g);
+            tt_clear(&tt);
+            SearchResult r;
+            search_position(&g, &limits, &tt, &r, 0);
+            secs += r.seconds;
+            nodes += r.nodes;
+        }
+        double nps = secs > 0 ? (double)nodes / secs : 0.0;
+        if (threads == 1) { base_time = secs; base_nps = nps; }
+        printf("%7d %12.3f %14llu %12.0f %9.2f %10.2f\n", threads, secs, nodes, nps,
+               secs > 0 ? base_time / secs : 0.0, base_nps > 0 ? nps / base_nps : 0.0);
+        if (threads == max_threads) break;
+    }
+    tt_free(&tt);
+    return 0;
+}
+
+/* tbgen <max_pieces> <file> [--threads N] */
+int tbgen_main(int argc, char **argv) {
+    if (argc < 2) { printf("usage: tbgen <max_pieces> <file> [--threads N]\n"); return 1; }
+    int max_pieces = atoi(argv[0]);
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc >= 4 && strcmp(argv[2], "--threads") == 0) threads = atoi(argv[3]);
+    TBSet set;
+    double t0 = now_seconds();
+    if (!tb_generate(&set, max_pieces, threads)) { printf("Cannot generate %d-piece tables.\n", max_pieces); return 1; }
+    int ok = tb_write(&set, argv[1]);
+    tb_free_set(&set);
+    printf("%s %s in %.2f s\n", ok ? "wrote" : "FAILED to write", argv[1], now_seconds() - t0);
+    return ok ? 0 : 1;
+}
+
+/* Times every available BitBackend over a random board array and checks
+   they agree with the portable one. */
+int bitbench_main(int argc, char **argv) {
+    size_t n = argc > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 1u << 20;
+    if (n == 0) n = 1;
+    unsigned long long *boards = malloc(n * sizeof *boards);
+    unsigned char *counts = malloc(n);
+    unsigned char *expect = malloc(n);
+    if (!boards || !counts || !expect) { fprintf(stderr, "out of memory\n"); return 1; }
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < n; ++i) boards[i] = splitmix64(&seed) & splitmix64(&seed) & DARK_SQUARES;
+
+    const BitBackend *list[4];
+    int nb = available_bitops(list);
+    BITOPS_PORTABLE.popcount_array(boards, MIDDLE_ROWS, expect, n);
+    unsigned long long expect_sum = BITOPS_PORTABLE.popcount_sum(boards, n);
+    int reps = n >= (1u << 20) ? 5 : (int)((5u << 20) / n);
+    int failures = 0;
+
+    printf("%zu boards, active backend: %s\n", n, bitops->name);
+    printf("%-12s %10s %10s %10s %10s\n", "backend", "popcnt", "array", "sum", "pext+pdep");
+    for (int b = 0; b < nb; ++b) {
+        const BitBackend *be = list[b];
+        volatile unsigned long long sink = 0;
+        double t0 = now_seconds();
+        for (int r = 0; r < reps; ++r)
+            for (size_t i = 0; i < n; ++i) sink += (unsigned long long)be->popcount64(boards[i]);
+        double t1 = now_seconds();
+        for (int r = 0; r < reps; ++r) be->popcount_array(boards, MIDDLE_ROWS, counts, n);
+        double t2 = now_seconds();
+        unsigned long long sum = 0;
+        for (int r = 0; r < reps; ++r) sum = be->popcount_sum(boards, n);
+        double t3 = now_seconds();
+        for (int r = 0; r < reps; ++r)
+            for (size_t i = 0; i < n; ++i) {
+                unsigned long long packed = be->pext64(boards[i], DARK_SQUARES);
+                if (be->pdep64(packed, DARK_SQUARES) != boards[i]) failures++;
+            }
+        double t4 = now_seconds();
+        (void)sink;
+        if (sum != expect_sum || memcmp(counts, expect, n) != 0) failures++;
+        for (size_t i = 0; i < n && i < 4096; ++i) {
+            if (boards[i] && be->lsb64(boards[i]) != LowestBit64(boards[i])) failures++;
+            if (be->clear_lsb64(boards[i]) != (boards[i] & (boards[i] - 1ULL))) failures++;
+        }
+        double per = 1e9 / ((double)n * reps);
+        printf("%-12s %10.2f %10.2f %10.2f %10.2f  ns/board\n", be->name,
+               (t1 - t0) * per, (t2 - t1) * per, (t3 - t2) * per, (t4 - t3) * per);
+    }
+    printf("%d failure(s)\n", failures);
+    free(boards); free(counts); free(expect);
+    return failures ? 1 : 0;
+}
+
+/* Times evaluate_red() one position at a time against every batch
+   kernel on positions from random games, and checks they agree. */
+int evalbench_main(int argc, char **argv) {
+    size_t n = argc > 0 ? (size_t)strtoull(argv[0], NULL, 10) : (size_t)1 << 20;
+    if (n == 0) n = 1;
+    GameState *pos = malloc(n * sizeof(GameState));
+    unsigned long long *boards = malloc(4 * n * sizeof(unsigned long long));
+    int *ref = malloc(n * sizeof(int)), *out = malloc(n * sizeof(int));
+    if (!pos || !boards || !ref || !out) { printf("out of memory\n"); return 1; }
+    unsigned long long *rm = boards, *rk = boards + n, *bm = boards + 2 * n, *bk = boards + 3 * n;
+
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    GameState g;
+    init_game(&g);
+    for (size_t i = 0, ply = 0; i < n; ++i, ++ply) {
+        Move moves[MAX_MOVES];
+        int nm = generate_moves(&g, g.turn, moves);
+        if (nm == 0 || ply >= 150) { init_game(&g); ply = 0; nm = generate_moves(&g, g.turn, moves); }
+        apply_move(&g, &moves[splitmix64(&seed) % (unsigned long long)nm]);
+        pos[i] = g;
+        rm[i] = g.red_man; rk[i] = g.red_king; bm[i] = g.blk_man; bk[i] = g.blk_king;
+    }
+
+    int reps = n >= ((size_t)1 << 20) ? 5 : (int)(((size_t)5 << 20) / n);
+    double t0 = now_seconds();
+    for (int r = 0; r < reps; ++r)
+        for (size_t i = 0; i < n; ++i) ref[i] = evaluate_red(&pos[i]);
+    double base = now_seconds() - t0;
+    double total = (double)n * reps;
+    printf("%zu positions\n%-22s %8.1f M positions/s\n", n, "evaluate_red", total / base / 1e6);
+    int failures = 0;
+    for (int k = 0; k < EVAL_KERNEL_COUNT; ++k) {
+        if (!eval_kernel_supported(k)) continue;
+        memset(out, 0, n * sizeof(int));
+        t0 = now_seconds();
+        for (int r = 0; r < reps; ++r) EVAL_KERNELS[k].fn(rm, rk, bm, bk, n, out);
+        double secs = now_seconds() - t0;
+        size_t bad = 0;
+        for (size_t i = 0; i < n; ++i) bad += (out[i] != ref[i]);
+        failures += bad != 0;
+        char label[32];
+        snprintf(label, sizeof(label), "batch %s", EVAL_KERNELS[k].name);
+        printf("%-22s %8.1f M positions/s  x%.2f  %zu mismatch(es)\n", label,
+               total / secs / 1e6, base / secs, bad);
+    }
+    free(pos); free(boards); free(ref); free(out);
+    return failures ? 1 : 0;
+}
+
+/*
+
+   Micro-benchmarks
+
+   ./bitboard_checkers microbench [--reps N] [--positions N] [--seed N] [--json]
+
+   Times the rules-engine entry points one at a time on a seeded corpus
+   of mid-game positions (plies 12-40 of random games): coord_to_index,
+   parse_move_input, validate_simple_move, execute_move (on a copy of the
+   position), player_has_capture, player_has_any_move and the bit
+   primitives.  After one warm-up pass, every repetition times a whole
+   pass over the corpus, and the median of those per-call means is the
+   "median" figure.  A second set of repetitions times the corpus in
+   batches of MICRO_BATCH calls (less the cost of reading the clock);
+   the "p99" figure is the 99th percentile of those per-call batch
+   times, so it shows the slow positions a pass mean hides.  --json
+   prints one object that can be diffed between commits.
+
+*/
+
+typedef struct {
+    GameState pos;
+    int player;
+    int from, to;                /* first step of a legal move */
+    char coord[4];
+    char move_text[16];
+    unsigned long long board;    /* a piece board, for the bit primitives */
+    int bit;
+} MicroCase;
+
+typedef struct {
+    MicroCase *cases;
+    int n;
+    volatile unsigned long long sink;
+} MicroCorpus;
+
+typedef void (*MicroFn)(MicroCorpus *c);
+
+#define MICRO_BATCH 8            /* calls per timed batch for the p99 */
+
+static void mb_coord_to_index(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += (unsigned long long)coord_to_index(c->cases[i].coord);
+    c->sink += acc;
+}
+static void mb_parse_move_input(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) {
+        int from, to;
+        acc += (unsigned long long)parse_move_input(c->cases[i].move_text, &from, &to) + (unsigned long long)to;
+    }
+    c->sink += acc;
+}
+static void mb_validate_simple_move(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) {
+        MicroCase *k = &c->cases[i];
+        int cap;
+        acc += (unsigned long long)validate_simple_move(&k->pos, k->player, k->from, k->to, &cap) + (unsigned long long)cap;
+    }
+    c->sink += acc;
+}
+static void mb_execute_move(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) {
+        MicroCase *k = &c->cases[i];
+        GameState g = k->pos;
+        acc += (unsigned long long)execute_move(&g, k->player, k->from, k->to) + g.red_man;
+    }
+    c->sink += acc;
+}
+static void mb_player_has_capture(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += (unsigned long long)player_has_capture(&c->cases[i].pos, c->cases[i].player);
+    c->sink += acc;
+}
+static void mb_player_has_any_move(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += (unsigned long long)player_has_any_move(&c->cases[i].pos, c->cases[i].player);
+    c->sink += acc;
+}
+static void mb_count_bits64(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += (unsigned long long)CountBits64(c->cases[i].board);
+    c->sink += acc;
+}
+static void mb_lowest_bit64(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += (unsigned long long)LowestBit64(c->cases[i].board);
+    c->sink += acc;
+}
+static void mb_get_set_clear_bit64(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) {
+        MicroCase *k = &c->cases[i];
+        acc += (unsigned long long)GetBit64(k->board, k->bit) + SetBit64(k->board, k->bit) + ClearBit64(k->board, k->bit);
+    }
+    c->sink += acc;
+}
+static void mb_pack_board32(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += pack_board32(c->cases[i].board);
+    c->sink += acc;
+}
+static void mb_bitops_popcount64(MicroCorpus *c) {
+    unsigned long long acc = 0;
+    for (int i = 0; i < c->n; ++i) acc += (unsigned long long)bitops->popcount64(c->cases[i].board);
+    c->sink += acc;
+}
+
+static const struct { const char *name; MicroFn fn; } MICRO_BENCHES[] = {
+    { "coord_to_index", mb_coord_to_index },
+    { "parse_move_input", mb_parse_move_input },
+    { "validate_simple_move", mb_validate_simple_move },
+    { "execute_move", mb_execute_move },
+    { "player_has_capture", mb_player_has_capture },
+    { "player_has_any_move", mb_player_has_any_move },
+    { "CountBits64", mb_count_bits64 },
+    { "LowestBit64", mb_lowest_bit64 },
+    { "Get/Set/ClearBit64", mb_get_set_clear_bit64 },
+    { "pack_board32", mb_pack_board32 },
+    { "bitops->popcount64", mb_bitops_popcount64 },
+};
+#define MICRO_BENCH_COUNT ((int)(sizeof(MICRO_BENCHES) / sizeof(MICRO_BENCHES[0])))
+
+static int micro_build_corpus(MicroCorpus *c, int n, unsigned long long seed) {
+    c->cases = calloc((size_t)n, sizeof(MicroCase));
+    c->n = 0;
+    if (!c->cases) return 0;
+    while (c->n < n) {
+        GameState g;
+        init_game(&g);
+        int target = 12 + (int)(splitmix64(&seed) % 29);
+        int ply = 0;
+        Move moves[MAX_MOVES];
+        int nm = generate_moves(&g, g.turn, moves);
+        while (ply < target && nm > 0) {
+            apply_move(&g, &moves[splitmix64(&seed) % (unsigned long long)nm]);
+            nm = generate_moves(&g, g.turn, moves);
+            ply++;
+        }
+        if (nm == 0) continue;
+        MicroCase *k = &c->cases[c->n++];
+        const Move *m = &moves[splitmix64(&seed) % (unsigned long long)nm];
+        k->pos = g;
+        k->player = g.turn;
+        k->from = m->from_idx;
+        k->to = m->njumps ? m->path[0] : m->to_idx;
+        index_to_coord(k->from, k->coord);
+        k->coord[2] = '\0';
+        char to[4] = { 0 };
+        index_to_coord(k->to, to);
+        snprintf(k->move_text, sizeof(k->move_text), "%s%s%s", k->coord, m->njumps ? "x" : "-", to);
+        k->board = (g.turn == 0) ? all_red(&g) : all_black(&g);
+        k->bit = (int)(splitmix64(&seed) & 63);
+    }
+    return 1;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* Median cost of one clock_ns() pair, taken off every batch time. */
+static double clock_overhead_ns(void) {
+    double d[101];
+    for (int i = 0; i < 101; ++i) {
+        double t0 = clock_ns();
+        d[i] = clock_ns() - t0;
+    }
+    qsort(d, 101, sizeof(double), cmp_double);
+    return d[50];
+}
+
+int microbench_main(int argc, char **argv) {
+    int reps = 101, npos = 4096, json = 0;
+    unsigned long long seed = 20240601ULL;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--positions") == 0 && i + 1 < argc) npos = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--json") == 0) json = 1;
+        else { printf("Unknown option %s\n", argv[i]); return 1; }
+    }
+    if (reps < 1) reps = 1;
+    if (npos < 1) npos = 1;
+    MicroCorpus c;
+    c.sink = 0;
+    int batch = npos < MICRO_BATCH ? npos : MICRO_BATCH;
+    size_t nbatch = (size_t)reps * (size_t)(npos / batch);
+    double *samples = malloc(sizeof(double) * (size_t)reps);
+    double *batches = malloc(sizeof(double) * nbatch);
+    if (!micro_build_corpus(&c, npos, seed) || !samples || !batches) {
+        printf("out of memory\n");
+        free(samples); free(batches); free(c.cases);
+        return 1;
+    }
+    double overhead = clock_overhead_ns();
+
+    if (json) printf("{\"positions\":%d,\"reps\":%d,\"seed\":%llu,\"bitops\":\"%s\",\"batch\":%d,\"benchmarks\":[",
+                     npos, reps, seed, bitops->name, batch);
+    else printf("%d positions, %d reps, seed %llu, bit backend %s\n%-24s %10s %10s\n",
+                npos, reps, seed, bitops->name, "function", "median ns", "p99 ns");
+    for (int b = 0; b < MICRO_BENCH_COUNT; ++b) {
+        MICRO_BENCHES[b].fn(&c);                        /* warm-up */
+        for (int r = 0; r < reps; ++r) {
+            double t0 = clock_ns();
+            MICRO_BENCHES[b].fn(&c);
+            samples[r] = (clock_ns() - t0) / npos;
+        }
+        size_t k = 0;
+        for (int r = 0; r < reps; ++r) {
+            for (int off = 0; off + batch <= npos; off += batch) {
+                MicroCorpus part = { c.cases + off, batch, 0 };
+                double t0 = clock_ns();
+                MICRO_BENCHES[b].fn(&part);
+                double t = clock_ns() - t0 - overhead;
+                batches[k++] = (t > 0 ? t : 0) / batch;
+                c.sink += part.sink;
+            }
+        }
+        qsort(samples, (size_t)reps, sizeof(double), cmp_double);
+        qsort(batches, nbatch, sizeof(double), cmp_double);
+        double median = samples[reps / 2];
+        double p99 = batches[(nbatch * 99) / 100 < nbatch ? (nbatch * 99) / 100 : nbatch - 1];
+        if (json) printf("%s{\"name\":\"%s\",\"median_ns\":%.3f,\"p99_ns\":%.3f}", b ? "," : "",
+                         MICRO_BENCHES[b].name, median, p99);
+        else printf("%-24s %10.2f %10.2f\n", MICRO_BENCHES[b].name, median, p99);
+    }
+    if (json) printf("]}\n");
+    free(samples);
+    free(batches);
+    free(c.cases);
+    return 0;
+}
+
+/* nnue gen <file> [seed]: writes a network with random weights (for
+   testing the file format and kernels; it does not play well).
+   nnue bench <file> [positions]: along random games, checks that every
+   kernel's incremental accumulator equals a full recompute and gives
+   the same score, then times full, incremental and forward-only
+   evaluation per kernel. */
+static int nnue_gen(const char *path, unsigned long long seed) {
+    NnueFile *w = calloc(1, sizeof(NnueFile));
+    if (!w) return 1;
+    memcpy(w->magic, "BBCKNNU1", 8);
+    w->inputs = NNUE_INPUTS;
+    w->hidden = NNUE_HIDDEN;
+    w->l2 = NNUE_L2;
+    for (int i = 0; i < NNUE_INPUTS; ++i)
+        for (int j = 0; j < NNUE_HIDDEN; ++j) w->w1[i][j] = (short)((int)(splitmix64(&seed) % 65) - 32);
+    for (int j = 0; j < NNUE_HIDDEN; ++j) w->b1[j] = (short)(splitmix64(&seed) % 64);
+    for (int i = 0; i < NNUE_L2; ++i) {
+        /* the full int8 range, so the kernels are checked at the extremes */
+        for (int j = 0; j < 2 * NNUE_HIDDEN; ++j) w->w2[i][j] = (signed char)((int)(splitmix64(&seed) % 256) - 128);
+        w->b2[i] = (int)(splitmix64(&seed) % 8192) - 4096;
+        w->w3[i] = (int)(splitmix64(&seed) % 17) - 8;
+    }
+    FILE *f = fopen(path, "wb");
+    int ok = f && fwrite(w, sizeof(*w), 1, f) == 1;
+    if (f && fclose(f) != 0) ok = 0;
+    free(w);
+    if (!ok) { printf("Could not write %s\n", path); return 1; }
+    printf("wrote %s (%zu bytes)\n", path, sizeof(NnueFile));
+    return 0;
+}
+
+static int nnue_bench(const char *path, size_t n) {
+    NnueNet *net = nnue_open(path);
+    if (!net) return 1;
+    GameState *pos = malloc(n * sizeof(GameState));
+    Move *mv = malloc(n * sizeof(Move));
+    unsigned char *fresh = malloc(n);    /* a new game starts at i */
+    int *ref = malloc(n * sizeof(int));
+    if (!pos || !mv || !fresh || !ref) { printf("out of memory\n"); return 1; }
+
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    GameState g;
+    init_game(&g);
+    g.key = compute_key(&g);
+    for (size_t i = 0, ply = 0; i < n; ++i, ++ply) {
+        Move moves[MAX_MOVES];
+        int nm = generate_moves(&g, g.turn, moves);
+        fresh[i] = (i == 0);
+        if (nm == 0 || ply >= 150) {
+            init_game(&g);
+            ply = 0;
+            fresh[i] = 1;
+            nm = generate_moves(&g, g.turn, moves);
+        }
+        pos[i] = g;
+        mv[i] = moves[splitmix64(&seed) % (unsigned long long)nm];
+        apply_move(&g, &mv[i]);
+    }
+
+    /* Reference: scalar full recompute of every position after its move. */
+    NnueNet scalar = *net;
+    scalar.update = nnue_update_scalar;
+    scalar.forward = nnue_forward_scalar;
+    NnueAcc a, b;
+    for (size_t i = 0; i < n; ++i) {
+        GameState after = pos[i];
+        apply_move(&after, &mv[i]);
+        nnue_refresh(&scalar, &after, &a);
+        ref[i] = nnue_evaluate(&scalar, &a, after.turn);
+    }
+
+    printf("%zu positions, %zu-byte network, search kernel %s\n", n, net->size, net->kernel);
+    printf("%-8s %12s %12s %12s %10s\n", "kernel", "full/s", "incr/s", "forward/s", "mismatch");
+    int failures = 0;
+    for (int k = 0; k < NNUE_KERNEL_COUNT; ++k) {
+        if (!nnue_kernel_supported(k)) continue;
+        NnueNet kn = *net;
+        kn.update = NNUE_KERNELS[k].update;
+        kn.forward = NNUE_KERNELS[k].forward;
+
+        size_t bad = 0;
+        NnueAcc *cur = &a, *next = &b;
+        for (size_t i = 0; i < n; ++i) {
+            if (fresh[i]) nnue_refresh(&kn, &pos[i], cur);
+            nnue_make(&kn, cur, next, &pos[i], &mv[i]);
+            NnueAcc full;
+            GameState after = pos[i];
+            apply_move(&after, &mv[i]);
+            nnue_refresh(&kn, &after, &full);
+            if (memcmp(&full, next, sizeof(full)) != 0 || nnue_evaluate(&kn, next, after.turn) != ref[i]) bad++;
+            NnueAcc *t = cur; cur = next; next = t;
+        }
+        failures += bad != 0;
+
+        volatile int sink = 0;
+        double t0 = now_seconds();
+        for (size_t i = 0; i < n; ++i) {
+            nnue_refresh(&kn, &pos[i], cur);
+            sink += nnue_evaluate(&kn, cur, pos[i].turn);
+        }
+        double full_s = now_seconds() - t0;
+        t0 = now_seconds();
+        for (size_t i = 0; i < n; ++i) {
+            if (fresh[i]) nnue_refresh(&kn, &pos[i], cur);
+            nnue_make(&kn, cur, next, &pos[i], &mv[i]);
+            sink += nnue_evaluate(&kn, next, 1 - pos[i].turn);
+            NnueAcc *t = cur; cur = next; next = t;
+        }
+        double incr_s = now_seconds() - t0;
+        t0 = now_seconds();
+        for (size_t i = 0; i < n; ++i) sink += nnue_evaluate(&kn, cur, (int)(i & 1));
+        double fwd_s = now_seconds() - t0;
+        (void)sink;
+        printf("%-8s %12.0f %12.0f %12.0f %10zu\n", NNUE_KERNELS[k].name,
+               n / full_s, n / incr_s, n / fwd_s, bad);
+    }
+    printf("%d failure(s)\n", failures);
+    free(pos); free(mv); free(fresh); free(ref);
+    nnue_close(net);
+    return failures ? 1 : 0;
+}
+
+int nnue_main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[0], "gen") == 0)
+        return nnue_gen(argv[1], argc > 2 ? strtoull(argv[2], NULL, 10) : 1ULL);
+    if (argc >= 2 && strcmp(argv[0], "bench") == 0) {
+        size_t n = argc > 2 ? (size_t)strtoull(argv[2], NULL, 10) : (size_t)200000;
+        return nnue_bench(argv[1], n ? n : 1);
+    }
+    printf("usage: nnue gen <file> [seed] | nnue bench <file> [positions]\n");
+    return 1;
+}
+
+/* tbprobe <file> <position> */
+int tbprobe_main(int argc, char **argv) {
+    if (argc < 2) { printf("usage: tbprobe <file> <position>\n"); return 1; }
+    TableBase *tb = tb_open(argv[0]);
+    GameState g;
+    if (!tb) { printf("Could not open tablebase %s\n", argv[0]); return 1; }
+    if (!parse_position(argv[1], &g)) { printf("Bad position.\n"); tb_close(tb); return 1; }
+    int dist = 0;
+    int r = tb_probe(tb, &g, &dist);
+    if (r == TB_UNKNOWN) printf("not in tablebase\n");
+    else if (r == TB_DRAW) printf("draw\n");
+    else printf("%s wins in %s%d plies\n", ((r == TB_WIN) == (g.turn == 0)) ? "red" : "black",
+                dist >= TB_FAR_DIST ? "at least " : "", dist);
+    tb_close(tb);
+    return 0;
+}
+
+int search_main(int argc, char **argv) {
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    const char *pos = "startpos";
+    size_t hash_mb = TT_DEFAULT_MB;
+    for (int i = 0; i < argc; ) {
+        int used = parse_limit_arg(argc - i, argv + i, &limits);
+        if (used) { i += used; continue; }
+        used = parse_tb_arg(argc - i, argv + i);
+        if (used < 0) return 1;
+        if (used) { i += used; continue; }
+        used = parse_nnue_arg(argc - i, argv + i);
+        if (used < 0) return 1;
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) { hash_mb = (size_t)atoi(argv[i + 1]); i += 2; continue; }
+        pos = argv[i++];
+    }
+    if (!limits.depth && !limits.nodes && !limits.movetime_ms) limits.movetime_ms = 1000;
+    GameState g;
+    if (!parse_position(pos, &g)) { printf("Bad position.\n"); return 1; }
+
+    TransTable tt;
+    if (!tt_init(&tt, hash_mb)) { printf("Could not allocate %zu MB hash.\n", hash_mb); return 1; }
+    SearchResult r;
+    search_position(&g, &limits, &tt, &r, 1);
+    printf("hash %zu MB%s, probes %llu, hits %llu, hashfull %d\n", tt.bytes >> 20,
+           tt.huge_pages ? " (huge pages)" : "", r.tt_probes, r.tt_hits, r.hashfull);
+    if (active_tb) printf("tablebase hits %llu\n", r.tb_hits);
+    tt_free(&tt);
+    if (!r.has_move) { printf("bestmove none\n"); return 0; }
+    char buf[MOVE_STR_LEN];
+    move_to_string(&r.best, buf);
+    printf("bestmove %s\n", buf);
+    return 0;
+}
+
+/* Like search, but prints the search statistics as JSON: one line per
+   iteration (main thread counters) and a final line summed over all
+   threads. */
+int stats_main(int argc, char **argv) {
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    const char *pos = "startpos";
+    size_t hash_mb = TT_DEFAULT_MB;
+    for (int i = 0; i < argc; ) {
+        int used = parse_limit_arg(argc - i, argv + i, &limits);
+        if (used) { i += used; continue; }
+        used = parse_nnue_arg(argc - i, argv + i);
+        if (used < 0) return 1;
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) { hash_mb = (size_t)atoi(argv[i + 1]); i += 2; continue; }
+        pos = argv[i++];
+    }
+    if (!limits.depth && !limits.nodes && !limits.movetime_ms) limits.movetime_ms = 1000;
+    GameState g;
+    if (!parse_position(pos, &g)) { printf("{\"error\":\"bad position\"}\n"); return 1; }
+    TransTable tt;
+    if (!tt_init(&tt, hash_mb)) { printf("{\"error\":\"hash allocation failed\"}\n"); return 1; }
+    SearchResult r;
+    search_position(&g, &limits, &tt, &r, 3);
+    print_stats_json(&r, "total");
+    tt_free(&tt);
+    return 0;
+}
+
+/*
+
+   Engine protocol
+
+   ./bitboard_checkers protocol
+
+   Line-oriented, for GUIs and the match runner: no banners, no board
+   printing and no Phase 1 tests.  One command per line:
+
+     protocol                  -> "id name ..." lines, then "protocolok"
+     isready                   -> "readyok"
+     newgame                   start position, hash table cleared
+     position startpos|fen <fen>|<fen> [moves <m1> <m2> ...]
+     moves <m1> <m2> ...       play moves from the current position
+     go [depth N] [nodes N] [movetime ms] [threads N] [infinite] [ponder]
+                               -> "info depth ..." per iteration, then
+                                  "bestmove <m>" or "bestmove none"
+     ponderhit                 the opponent played the move a "go ponder"
+                               search assumed: its limits start now
+     stop                      end the running search now
+     setoption hash <MB> | threads <N> | tb <file>
+     d                         -> "position <fen>"
+     quit
+
+   Moves are written "b3-c4" / "b3xd5xf7" or in PDN numbers "11-15" /
+   "11x18x25".  A go without limits searches until stop (or a proven
+   result).  "go ponder" is sent with the position after the expected
+   reply while the opponent thinks; it searches without a budget and
+   holds its bestmove back until ponderhit or stop.  Errors are reported
+   as "error <text>" lines.
+
+   Lines are tokenised in place, output is fully buffered and flushed
+   once per response, and the hash table is only allocated by the first
+   go, so the process answers its first command right after exec.  The
+   search runs on its own thread so stop and quit are read while it
+   thinks.
+
+*/
+
+typedef struct {
+    GameState pos;
+    size_t hash_mb;
+    int threads;
+    TransTable tt;
+    int have_tt;
+    atomic_int stop;
+    atomic_int ponder;
+    int searching;
+    pthread_t thread;
+    GameState search_pos;         /* the search thread's copies */
+    SearchLimits search_limits;
+} Protocol;
+
+/* Next whitespace-separated token after *p, without copying: returns its
+   start, sets *len (0 at the end of the line) and advances *p past it. */
+static const char *next_token(const char **p, size_t *len) {
+    const char *s = *p;
+    while (*s && isspace((unsigned char)*s)) s++;
+    const char *start = s;
+    while (*s && !isspace((unsigned char)*s)) s++;
+    *len = (size_t)(s - start);
+    *p = s;
+    return start;
+}
+
+static int token_is(const char *tok, size_t len, const char *word) {
+    return strlen(word) == len && strncmp(tok, word, len) == 0;
+}
+
+/* Unsigned decimal value of a token, -1 if it is not a number. */
+static long long token_number(const char *tok, size_t len) {
+    if (len == 0 || len > 18) return -1;
+    long long v = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (!isdigit((unsigned char)tok[i])) return -1;
+        v = v * 10 + (tok[i] - '0');
+    }
+    return v;
+}
+
+static void *protocol_search_main(void *arg) {
+    Protocol *pr = (Protocol *)arg;
+    SearchResult r;
+    search_position(&pr->search_pos, &pr->search_limits, pr->have_tt ? &pr->tt : NULL, &r, 2);
+    /* A ponder search that ran out of depth waits for ponderhit or stop. */
+    struct timespec nap = { 0, 1000000L };
+    while (atomic_load(&pr->ponder) && !atomic_load(&pr->stop)) nanosleep(&nap, NULL);
+    if (r.has_move) {
+        char buf[MOVE_STR_LEN];
+        move_to_string(&r.best, buf);
+        printf("bestmove %s\n", buf);
+    } else {
+        printf("bestmove none\n");
+    }
+    fflush(stdout);
+    return NULL;
+}
+
+/* Stops the running search, if any, and waits for its bestmove. */
+static void protocol_wait(Protocol *pr) {
+    if (!pr->searching) return;
+    atomic_store(&pr->stop, 1);
+    pthread_join(pr->thread, NULL);
+    pr->searching = 0;
+    atomic_store(&pr->ponder, 0);
+}
+
+/* Applies the moves in the rest of the line to pr->pos. */
+static int protocol_moves(Protocol *pr, const char *p) {
+    size_t len;
+    const char *tok;
+    while (tok = next_token(&p, &len), len) {
+        Move m;
+        if (!parse_move_string(&pr->pos, tok, len, &m)) {
+            printf("error illegal move %.*s\n", (int)len, tok);
+            return 0;
+        }
+        apply_move(&pr->pos, &m);
+    }
+    return 1;
+}
+
+static void protocol_position(Protocol *pr, const char *p) {
+    size_t len;
+    const char *tok = next_token(&p, &len);
+    if (token_is(tok, len, "fen")) tok = next_token(&p, &len);
+    GameState g;
+    if (!len || !parse_position(tok, &g)) { printf("error bad position\n"); return; }
+    pr->pos = g;
+    tok = next_token(&p, &len);
+    if (token_is(tok, len, "moves")) protocol_moves(pr, p);
+    else if (len) printf("error unexpected %.*s\n", (int)len, tok);
+}
+
+static void protocol_go(Protocol *pr, const char *p) {
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    limits.threads = pr->threads;
+    limits.stop_flag = &pr->stop;
+    limits.ponder = &pr->ponder;
+    int ponder = 0;
+    size_t len;
+    const char *tok;
+    while (tok = next_token(&p, &len), len) {
+        if (token_is(tok, len, "infinite")) continue;
+        if (token_is(tok, len, "ponder")) { ponder = 1; continue; }
+        size_t vlen;
+        const char *val = next_token(&p, &vlen);
+        long long v = token_number(val, vlen);
+        if (v < 0) { printf("error bad go argument %.*s\n", (int)len, tok); return; }
+        if (token_is(tok, len, "depth")) limits.depth = (int)v;
+        else if (token_is(tok, len, "nodes")) limits.nodes = (unsigned long long)v;
+        else if (token_is(tok, len, "movetime")) limits.movetime_ms = (int)v;
+        else if (token_is(tok, len, "threads")) limits.threads = (int)v;
+        else { printf("error bad go argument %.*s\n", (int)len, tok); return; }
+    }
+    if (!pr->have_tt) {
+        pr->have_tt = tt_init(&pr->tt, pr->hash_mb);
+        if (!pr->have_tt) printf("error could not allocate %zu MB hash, searching without\n", pr->hash_mb);
+    }
+    atomic_store(&pr->stop, 0);
+    atomic_store(&pr->ponder, ponder);
+    pr->search_pos = pr->pos;
+    pr->search_limits = limits;
+    if (pthread_create(&pr->thread, NULL, protocol_search_main, pr) != 0) {
+        printf("error could not start search\n");
+        return;
+    }
+    pr->searching = 1;
+}
+
+static void protocol_setoption(Protocol *pr, const char *p) {
+    size_t len, vlen;
+    const char *tok = next_token(&p, &len);
+    const char *val = next_token(&p, &vlen);
+    long long v = token_number(val, vlen);
+    if (token_is(tok, len, "hash") && v > 0) {
+        if (pr->have_tt) tt_free(&pr->tt);
+        pr->have_tt = 0;
+        pr->hash_mb = (size_t)v;
+    } else if (token_is(tok, len, "threads") && v > 0) {
+        pr->threads = (int)v;
+    } else if (token_is(tok, len, "tb") && vlen) {
+        char path[4096];
+        if (vlen >= sizeof(path)) { printf("error path too long\n"); return; }
+        memcpy(path, val, vlen);
+        path[vlen] = '\0';
+        tb_close(active_tb);
+        active_tb = tb_open(path);
+        if (!active_tb) printf("error could not open tablebase %s\n", path);
+    } else {
+        printf("error bad option %.*s\n", (int)len, tok);
+    }
+}
+
+int protocol_main(int argc, char **argv) {
+    (void)argc; (void)argv;
+    static char outbuf[1 << 16];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+    Protocol pr;
+    memset(&pr, 0, sizeof(pr));
+    init_game(&pr.pos);
+    pr.hash_mb = TT_DEFAULT_MB;
+    pr.threads = 1;
+    atomic_init(&pr.stop, 0);
+    atomic_init(&pr.ponder, 0);
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, stdin) >= 0) {
+        const char *p = line;
+        size_t len;
+        const char *cmd = next_token(&p, &len);
+        if (!len) continue;
+        if (token_is(cmd, len, "quit")) break;
+        if (token_is(cmd, len, "isready")) {
+            printf("readyok\n");
+            fflush(stdout);
+            continue;
+        }
+        if (token_is(cmd, len, "ponderhit")) {
+            /* the running search keeps going, now with its limits */
+            atomic_store(&pr.ponder, 0);
+            continue;
+        }
+        /* Everything else first ends a running search. */
+        protocol_wait(&pr);
+        if (token_is(cmd, len, "stop")) {
+            /* the search thread has printed its bestmove */
+        } else if (token_is(cmd, len, "protocol")) {
+            printf("id name BitBoard Checkers\nid variant english\nprotocolok\n");
+        } else if (token_is(cmd, len, "newgame")) {
+            init_game(&pr.pos);
+            if (pr.have_tt) tt_clear(&pr.tt);
+        } else if (token_is(cmd, len, "position")) {
+            protocol_position(&pr, p);
+        } else if (token_is(cmd, len, "moves")) {
+            protocol_moves(&pr, p);
+        } else if (token_is(cmd, len, "go")) {
+            protocol_go(&pr, p);
+        } else if (token_is(cmd, len, "setoption")) {
+            protocol_setoption(&pr, p);
+        } else if (token_is(cmd, len, "d")) {
+            char fen[POSITION_STR_LEN];
+            format_position(&pr.pos, fen);
+            printf("position %s\n", fen);
+        } else {
+            printf("error unknown command %.*s\n", (int)len, cmd);
+        }
+        fflush(stdout);
+    }
+    protocol_wait(&pr);
+    fflush(stdout);
+    free(line);
+    if (pr.have_tt) tt_free(&pr.tt);
+    tb_close(active_tb);
+    return 0;
+}
+
+/*
+
+   Position records
+
+   Fixed-width 20-byte training records: the four boards packed to the 32
+   playable squares (Board32), side to move, game result and search
+   score.  Result and score are from the side to move's point of view.
+   Fields are stored little-endian, as in memory on x86.
+
+   File: RecFileHeader, then either the records back to back (random
+   access is one multiply) or, with compression, blocks of REC_BLOCK
+   records followed by a table of block offsets.  A compressed block is
+   XOR-delta coded against the previous record, split into byte planes
+   and run-length coded with the tablebase RLE; consecutive positions of
+   a game differ in a few bits, so the planes are mostly zero runs.  A
+   block that would not shrink is stored raw.
+
+   RecWriter buffers one block and writes it whole; RecReader maps the
+   file and decodes one cached block at a time (one reader per thread).
+
+*/
+
+#define REC_BLOCK      4096
+#define REC_NO_SCORE   (-32768)
+
+enum { REC_LOSS = 0, REC_DRAW = 1, REC_WIN = 2, REC_UNKNOWN = 3 };
+
+typedef struct {
+    unsigned int red_man, red_king, blk_man, blk_king;
+    unsigned char turn;
+    unsigned char result;        /* REC_* for the side to move */
+    short score;                 /* side to move, REC_NO_SCORE if none */
+} PosRecord;
+
+_Static_assert(sizeof(PosRecord) == 20, "PosRecord must be 20 bytes");
+
+typedef struct {
+    char magic[8];
+    unsigned int record_size;
+    unsigned int block_records;  /* 0 = uncompressed */
+    unsigned long long count;
+    unsigned long long index_offset;   /* compressed: nblocks+1 block offsets */
+} RecFileHeader;
+
+static const char REC_MAGIC[8] = { 'B', 'B', 'C', 'K', 'R', 'E', 'C', '1' };
+
+void record_from_gamestate(GameState *g, int result, int score, PosRecord *r) {
+    Board32 b;
+    gamestate_to_board32(g, &b);
+    r->red_man = b.red_man;
+    r->red_king = b.red_king;
+    r->blk_man = b.blk_man;
+    r->blk_king = b.blk_king;
+    r->turn = (unsigned char)g->turn;
+    r->result = (unsigned char)result;
+    r->score = (short)score;
+}
+
+void record_to_gamestate(const PosRecord *r, GameState *g) {
+    Board32 b = { r->red_man, r->red_king, r->blk_man, r->blk_king };
+    board32_to_gamestate(&b, r->turn, g);
+}
+
+/* Delta + byte-plane transform of n records into planes (20*n bytes). */
+static void rec_to_planes(const PosRecord *recs, size_t n, unsigned char *planes) {
+    unsigned char prev[sizeof(PosRecord)];
+    memset(prev, 0, sizeof(prev));
+    for (size_t k = 0; k < n; ++k) {
+        const unsigned char *cur = (const unsigned char *)&recs[k];
+        for (size_t b = 0; b < sizeof(PosRecord); ++b) {
+            planes[b * n + k] = cur[b] ^ prev[b];
+            prev[b] = cur[b];
+        }
+    }
+}
+
+static void rec_from_planes(const unsigned char *planes, size_t n, PosRecord *recs) {
+    unsigned char prev[sizeof(PosRecord)];
+    memset(prev, 0, sizeof(prev));
+    for (size_t k = 0; k < n; ++k) {
+        unsigned char *cur = (unsigned char *)&recs[k];
+        for (size_t b = 0; b < sizeof(PosRecord); ++b) {
+            prev[b] ^= planes[b * n + k];
+            cur[b] = prev[b];
+        }
+    }
+}
+
+typedef struct {
+    FILE *f;
+    int compress;
+    PosRecord *block;
+    size_t nblock;
+    unsigned char *planes;       /* compression scratch: planes, then RLE */
+    unsigned char *packed;
+    unsigned long long count;
+    unsigned long long *offsets; /* compressed: start of every block */
+    size_t noffsets, cap_offsets;
+    int failed;
+} RecWriter;
+
+RecWriter *rec_writer_open(const char *path, int compress) {
+    RecWriter *w = calloc(1, sizeof(RecWriter));
+    if (!w) return NULL;
+    w->f = fopen(path, "wb");
+    w->compress = compress;
+    w->block = malloc(REC_BLOCK * sizeof(PosRecord));
+    if (compress) {
+        w->planes = malloc(REC_BLOCK * sizeof(PosRecord));
+        w->packed = malloc(REC_BLOCK * sizeof(PosRecord) * 2);
+    }
+    if (!w->f || !w->block || (compress && (!w->planes || !w->packed))) {
+        if (w->f) fclose(w->f);
+        free(w->block); free(w->planes); free(w->packed); free(w);
+        return NULL;
+    }
+    RecFileHeader h;
+    memset(&h, 0, sizeof(h));
+    fwrite(&h, sizeof(h), 1, w->f);          /* rewritten by rec_writer_close() */
+    return w;
+}
+
+static void rec_flush_block(RecWriter *w) {
+    if (!w->nblock) return;
+    size_t raw = w->nblock * sizeof(PosRecord);
+    if (!w->compress) {
+        if (fwrite(w->block, 1, raw, w->f) != raw) w->failed = 1;
+        w->nblock = 0;
+        return;
+    }
+    if (w->noffsets == w->cap_offsets) {
+        w->cap_offsets = w->cap_offsets ? 2 * w->cap_offsets : 256;
+        unsigned long long *grown = realloc(w->offsets, w->cap_offsets * sizeof(unsigned long long));
+        if (!grown) { w->failed = 1; w->nblock = 0; return; }
+        w->offsets = grown;
+    }
+    w->offsets[w->noffsets++] = (unsigned long long)ftell(w->f);
+    rec_to_planes(w->block, w->nblock, w->planes);
+    size_t len = tb_rle_encode(w->planes, raw, w->packed);
+    /* A block no smaller than raw is stored raw; the reader tells them apart by length. */
+    const void *data = (len < raw) ? (const void *)w->packed : (const void *)w->block;
+    if (len >= raw) len = raw;
+    if (fwrite(data, 1, len, w->f) != len) w->failed = 1;
+    w->nblock = 0;
+}
+
+int rec_write(RecWriter *w, const PosRecord *r) {
+    w->block[w->nblock++] = *r;
+    w->count++;
+    if (w->nblock == REC_BLOCK) rec_flush_block(w);
+    return !w->failed;
+}
+
+/* Flushes, writes the block table and header; returns 1 if every write succeeded. */
+int rec_writer_close(RecWriter *w) {
+    rec_flush_block(w);
+    RecFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, REC_MAGIC, 8);
+    h.record_size = sizeof(PosRecord);
+    h.count = w->count;
+    if (w->compress) {
+        h.block_records = REC_BLOCK;
+        h.index_offset = (unsigned long long)ftell(w->f);
+        unsigned long long end = h.index_offset;
+        fwrite(w->offsets, sizeof(unsigned long long), w->noffsets, w->f);
+        fwrite(&end, sizeof(end), 1, w->f);
+    }
+    fseek(w->f, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, w->f);
+    int ok = !w->failed && ferror(w->f) == 0;
+    if (fclose(w->f) != 0) ok = 0;
+    free(w->block); free(w->planes); free(w->packed); free(w->offsets); free(w);
+    return ok;
+}
+
+typedef struct {
+    const unsigned char *map;
+    size_t map_size;
+    RecFileHeader h;
+    const unsigned char *offsets;      /* unaligned, read with read_u64() */
+    long long cached;            /* block in `block`, -1 = none */
+    PosRecord *block;
+    unsigned char *planes;
+} RecReader;
+
+RecReader *rec_reader_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RecFileHeader)) { close(fd); return NULL; }
+    unsigned char *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    RecReader *r = calloc(1, sizeof(RecReader));
+    if (!r) { munmap(map, (size_t)st.st_size); return NULL; }
+    r->map = map;
+    r->map_size = (size_t)st.st_size;
+    memcpy(&r->h, map, sizeof(RecFileHeader));
+    r->cached = -1;
+    int ok = memcmp(r->h.magic, REC_MAGIC, 8) == 0 && r->h.record_size == sizeof(PosRecord);
+    if (ok && r->h.block_records == 0) {
+        ok = r->h.count <= (r->map_size - sizeof(RecFileHeader)) / sizeof(PosRecord);
+    } else if (ok) {
+        unsigned long long nblocks = (r->h.count + r->h.block_records - 1) / r->h.block_records;
+        ok = r->h.block_records == REC_BLOCK && r->h.index_offset <= r->map_size &&
+             (nblocks + 1) * sizeof(unsigned long long) <= r->map_size - r->h.index_offset;
+        r->offsets = map + r->h.index_offset;
+        r->block = malloc(REC_BLOCK * sizeof(PosRecord));
+        r->planes = malloc(REC_BLOCK * sizeof(PosRecord));
+        ok = ok && r->block && r->planes;
+    }
+    if (!ok) {
+        munmap((void *)r->map, r->map_size);
+        free(r->block); free(r->planes); free(r);
+        return NULL;
+    }
+    return r;
+}
+
+unsigned long long rec_count(const RecReader *r) {
+    return r->h.count;
+}
+
+/* Record i (0-based); returns 0 when i is out of range. */
+int rec_read(RecReader *r, unsigned long long i, PosRecord *out) {
+    if (i >= r->h.count) return 0;
+    if (r->h.block_records == 0) {
+        memcpy(out, r->map + sizeof(RecFileHeader) + i * sizeof(PosRecord), sizeof(PosRecord));
+        return 1;
+    }
+    unsigned long long blk = i / REC_BLOCK;
+    if ((long long)blk != r->cached) {
+        unsigned long long first = blk * REC_BLOCK;
+        size_t n = (size_t)((r->h.count - first < REC_BLOCK) ? r->h.count - first : REC_BLOCK);
+        size_t raw = n * sizeof(PosRecord);
+        unsigned long long off = read_u64(r->offsets + blk * sizeof(unsigned long long));
+        unsigned long long len = read_u64(r->offsets + (blk + 1) * sizeof(unsigned long long)) - off;
+        if (off > r->map_size || len > r->map_size - off) return 0;
+        if (len == raw) {
+            memcpy(r->block, r->map + off, raw);
+        } else {
+            tb_rle_decode(r->map + off, (size_t)len, r->planes, raw);
+            rec_from_planes(r->planes, n, r->block);
+        }
+        r->cached = (long long)blk;
+    }
+    *out = r->block[i % REC_BLOCK];
+    return 1;
+}
+
+void rec_reader_close(RecReader *r) {
+    if (!r) return;
+    munmap((void *)r->map, r->map_size);
+    free(r->block); free(r->planes); free(r);
+}
+
+/*
+
+   PDN replay
+
+   ./bitboard_checkers pdn [--threads N] [--errors N] <file.pdn>...
+
+   Memory-maps the files, cuts them into chunks on game boundaries and
+   replays every game of every chunk through generate_moves() on a pool
+   of threads.  Moves use the parse_move_string() conventions (PDN
+   numbers or coordinates).  Reports illegal moves, bad FEN tags and
+   results that contradict a finished game, plus totals.  A game lives
+   on the replaying thread's stack; nothing is allocated per game.
+   With `record` set a chunk also collects a PosRecord per position of
+   every valid game (records convert).
+
+   Results are read with the first number for the side that moves first
+   (B in the FEN, red here): "1-0"/"2-0" red wins, "0-1"/"0-2" black
+   wins, "1/2-1/2"/"1-1" draw, "*" unfinished.
+
+*/
+
+#define PDN_CHUNK          (1u << 20)
+#define PDN_CHUNK_ERRORS   16
+#define PDN_MOVE_TEXT      24
+
+enum { PDN_RED_WIN = 0, PDN_BLACK_WIN, PDN_DRAW, PDN_NO_RESULT };
+enum { PDN_ERR_ILLEGAL = 0, PDN_ERR_FEN, PDN_ERR_RESULT };
+
+typedef struct {
+    unsigned long long games;
+    unsigned long long plies;
+    unsigned long long illegal;      /* games stopped by an illegal move */
+    unsigned long long bad_fen;
+    unsigned long long mismatches;   /* result contradicts the final position */
+    unsigned long long results[4];   /* by PDN_* result */
+} PDNStats;
+
+typedef struct {
+    int kind;
+    unsigned int line;               /* within the chunk, 0-based */
+    unsigned int game;               /* within the chunk, 0-based */
+    int ply;                         /* of the bad move; plies played for a result */
+    char text[PDN_MOVE_TEXT];
+} PDNError;
+
+typedef struct {
+    const char *begin, *end;
+    int file;
+    unsigned int lines;              /* newlines in the chunk */
+    PDNStats stats;
+    PDNError errors[PDN_CHUNK_ERRORS];
+    int nerrors;
+    int record;                      /* collect PosRecords of valid games */
+    int score_depth;                 /* >0: score each record with a search */
+    PosRecord *records;
+    size_t nrecords, cap_records;
+} PDNChunk;
+
+typedef struct {
+    GameState pos;
+    int active;                      /* tags or moves seen */
+    int in_moves;
+    int failed;
+    int result;
+    int ply;
+    unsigned int line;               /* where the game started */
+    size_t first_record;             /* this game's records start here */
+} PDNGame;
+
+static GameState pdn_start;          /* set up once by pdn_open_corpus() */
+
+/* Any blank or control character; cheaper than isspace() per byte. */
+static inline int pdn_space(char c) {
+    return (unsigned char)c <= ' ';
+}
+
+static void pdn_error(PDNChunk *c, const PDNGame *g, int kind, unsigned int line, const char *text, size_t len) {
+    if (c->nerrors >= PDN_CHUNK_ERRORS) return;
+    PDNError *e = &c->errors[c->nerrors++];
+    e->kind = kind;
+    e->line = line;
+    e->game = (unsigned int)c->stats.games;
+    e->ply = g->ply + (kind == PDN_ERR_ILLEGAL);
+    if (len >= PDN_MOVE_TEXT) len = PDN_MOVE_TEXT - 1;
+    memcpy(e->text, text, len);
+    e->text[len] = '\0';
+}
+
+static void pdn_game_reset(PDNChunk *c, PDNGame *g, unsigned int line) {
+    g->pos = pdn_start;
+    g->first_record = c->nrecords;
+    g->active = 0;
+    g->in_moves = 0;
+    g->failed = 0;
+    g->result = PDN_NO_RESULT;
+    g->ply = 0;
+    g->line = line;
+}
+
+/* Appends g->pos to the chunk's records, result still unknown. */
+static void pdn_record(PDNChunk *c, PDNGame *g) {
+    if (c->nrecords == c->cap_records) {
+        size_t cap = c->cap_records ? 2 * c->cap_records : 4096;
+        PosRecord *grown = realloc(c->records, cap * sizeof(PosRecord));
+        if (!grown) { c->record = 0; return; }
+        c->records = grown;
+        c->cap_records = cap;
+    }
+    record_from_gamestate(&g->pos, REC_UNKNOWN, REC_NO_SCORE, &c->records[c->nrecords++]);
+}
+
+/* Fills in result (and score) of the finished game's records, or drops
+   them if the game did not replay. */
+static void pdn_label_records(PDNChunk *c, PDNGame *g) {
+    if (g->failed || !g->in_moves) { c->nrecords = g->first_record; return; }
+    pdn_record(c, g);
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    limits.depth = c->score_depth;
+    for (size_t i = g->first_record; i < c->nrecords; ++i) {
+        PosRecord *r = &c->records[i];
+        if (g->result == PDN_DRAW) r->result = REC_DRAW;
+        else if (g->result != PDN_NO_RESULT) r->result = ((g->result == PDN_RED_WIN) == (r->turn == 0)) ? REC_WIN : REC_LOSS;
+        if (c->score_depth > 0) {
+            GameState pos;
+            SearchResult sr;
+            record_to_gamestate(r, &pos);
+            search_position(&pos, &limits, NULL, &sr, 0);
+            r->score = (short)sr.score;
+        }
+    }
+}
+
+/* Counts the game and checks a decisive result against the final
+   position when the loser really has no move left. */
+static void pdn_game_finish(PDNChunk *c, PDNGame *g, unsigned int line) {
+    if (!g->active) return;
+    if (!g->failed && g->result != PDN_NO_RESULT) {
+        Move moves[MAX_MOVES];
+        if (generate_moves(&g->pos, g->pos.turn, moves) == 0) {
+            int expect = g->pos.turn == 0 ? PDN_BLACK_WIN : PDN_RED_WIN;
+            if (g->result != expect) {
+                static const char *NAMES[] = { "1-0", "0-1", "1/2-1/2" };
+                c->stats.mismatches++;
+                pdn_error(c, g, PDN_ERR_RESULT, g->line, NAMES[g->result], strlen(NAMES[g->result]));
+            }
+        }
+    }
+    if (c->record) pdn_label_records(c, g);
+    c->stats.games++;
+    c->stats.results[g->result]++;
+    pdn_game_reset(c, g, line);
+}
+
+/* PDN_* result for a game termination token, -1 for anything else. */
+static int pdn_result_token(const char *t, size_t len) {
+    if (len == 1 && t[0] == '*') return PDN_NO_RESULT;
+    if (len == 3 && t[1] == '-') {
+        if ((t[0] == '1' && t[2] == '0') || (t[0] == '2' && t[2] == '0')) return PDN_RED_WIN;
+        if ((t[0] == '0' && t[2] == '1') || (t[0] == '0' && t[2] == '2')) return PDN_BLACK_WIN;
+        if (t[0] == '1' && t[2] == '1') return PDN_DRAW;
+    }
+    if (len == 7 && strncmp(t, "1/2-1/2", 7) == 0) return PDN_DRAW;
+    return -1;
+}
+
+/* One [Name "value"] tag; p is at the '['.  Returns the end of the line. */
+static const char *pdn_tag(PDNChunk *c, PDNGame *g, const char *p, const char *end, unsigned int line) {
+    const char *eol = memchr(p, '\n', (size_t)(end - p));
+    if (!eol) eol = end;
+    const char *name = p + 1;
+    const char *q = name;
+    while (q < eol && !pdn_space(*q) && *q != ']') q++;
+    size_t name_len = (size_t)(q - name);
+    const char *val = memchr(q, '"', (size_t)(eol - q));
+    const char *val_end = val ? memchr(val + 1, '"', (size_t)(eol - val - 1)) : NULL;
+    g->active = 1;
+    if (!val || !val_end) return eol;
+    val++;
+    size_t len = (size_t)(val_end - val);
+    if (name_len == 3 && strncmp(name, "FEN", 3) == 0) {
+        char fen[POSITION_STR_LEN];
+        int ok = len < sizeof(fen);
+        if (ok) {
+            memcpy(fen, val, len);
+            fen[len] = '\0';
+            ok = parse_position(fen, &g->pos);
+        }
+        if (!ok) {
+            c->stats.bad_fen++;
+            pdn_error(c, g, PDN_ERR_FEN, line, val, len);
+            g->failed = 1;
+        }
+    } else if (name_len == 6 && strncmp(name, "Result", 6) == 0) {
+        int r = pdn_result_token(val, len);
+        if (r >= 0) g->result = r;
+    }
+    return eol;
+}
+
+static void pdn_replay_chunk(PDNChunk *c) {
+    const char *p = c->begin, *end = c->end;
+    unsigned int line = 0;
+    PDNGame g;
+    pdn_game_reset(c, &g, 0);
+    while (p < end) {
+        char ch = *p;
+        if (ch == '\n') { line++; p++; continue; }
+        if (pdn_space(ch)) { p++; continue; }
+        if (ch == '[') {
+            if (g.in_moves) pdn_game_finish(c, &g, line);
+            if (!g.active) g.line = line;
+            p = pdn_tag(c, &g, p, end, line);
+            continue;
+        }
+        if (ch == '{' || ch == '(') {
+            /* comments and variations; variations nest */
+            char close = (ch == '{') ? '}' : ')';
+            int depth = 0;
+            for (; p < end; ++p) {
+                if (*p == '\n') line++;
+                else if (*p == ch) depth++;
+                else if (*p == close && --depth == 0) { p++; break; }
+            }
+            continue;
+        }
+        if (ch == ';') {
+            while (p < end && *p != '\n') p++;
+            continue;
+        }
+        const char *tok = p;
+        while (p < end && !pdn_space(*p) && *p != '{' && *p != '(' && *p != '[') p++;
+        size_t len = (size_t)(p - tok);
+        if (tok[0] == '$') continue;                              /* NAG */
+        int r = pdn_result_token(tok, len);
+        if (r >= 0) {
+            g.active = 1;
+            g.result = r;
+            pdn_game_finish(c, &g, line);
+            continue;
+        }
+        /* Strip a move number ("12." or "12...") and trailing "!?" marks. */
+        size_t i = 0;
+        while (i < len && isdigit((unsigned char)tok[i])) i++;
+        if (i < len && tok[i] == '.') {
+            while (i < len && tok[i] == '.') i++;
+            tok += i;
+            len -= i;
+        }
+        while (len && (tok[len - 1] == '!' || tok[len - 1] == '?')) len--;
+        if (!len) continue;
+        if (!g.active) g.line = line;
+        g.active = 1;
+        g.in_moves = 1;
+        if (g.failed) continue;
+        Move m;
+        if (!parse_move_string(&g.pos, tok, len, &m)) {
+            c->stats.illegal++;
+            pdn_error(c, &g, PDN_ERR_ILLEGAL, line, tok, len);
+            g.failed = 1;
+            continue;
+        }
+        if (c->record) pdn_record(c, &g);
+        apply_move(&g.pos, &m);
+        g.ply++;
+        c->stats.plies++;
+    }
+    pdn_game_finish(c, &g, line);
+    c->lines = line;
+}
+
+/* Start of the first game at or after p: a '[' opening a line whose
+   previous line is not a tag line.  Returns end if there is none. */
+static const char *pdn_game_start(const char *base, const char *p, const char *end) {
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl || nl + 1 >= end) return end;
+        p = nl + 1;
+        if (*p != '[') continue;
+        const char *prev = nl;
+        while (prev > base && prev[-1] != '\n') prev--;
+        while (prev < nl && pdn_space(*prev)) prev++;
+        if (*prev != '[') return p;
+    }
+    return end;
+}
+
+typedef struct {
+    PDNChunk *chunks;
+    int nchunks;
+    atomic_int next;
+} PDNWork;
+
+static void *pdn_worker(void *arg) {
+    PDNWork *w = (PDNWork *)arg;
+    int i;
+    while ((i = atomic_fetch_add(&w->next, 1)) < w->nchunks) pdn_replay_chunk(&w->chunks[i]);
+    return NULL;
+}
+
+static void pdn_add_stats(PDNStats *to, const PDNStats *from) {
+    to->games += from->games;
+    to->plies += from->plies;
+    to->illegal += from->illegal;
+    to->bad_fen += from->bad_fen;
+    to->mismatches += from->mismatches;
+    for (int r = 0; r < 4; ++r) to->results[r] += from->results[r];
+}
+
+typedef struct {
+    const char **paths;
+    int nfiles;
+    const char **maps;
+    size_t *sizes;
+    PDNChunk *chunks;
+    int nchunks;
+} PDNCorpus;
+
+/* Maps the files and cuts them into chunks.  Files that cannot be read
+   are reported and skipped. */
+static void pdn_open_corpus(PDNCorpus *pc, const char **paths, int nfiles) {
+    memset(pc, 0, sizeof(*pc));
+    pc->paths = paths;
+    pc->nfiles = nfiles;
+    pc->maps = calloc((size_t)nfiles, sizeof(char *));
+    pc->sizes = calloc((size_t)nfiles, sizeof(size_t));
+    int cap = 0;
+    init_game(&pdn_start);
+    for (int f = 0; f < nfiles; ++f) {
+        int fd = open(paths[f], O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            printf("Could not open %s\n", paths[f]);
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        pc->sizes[f] = (size_t)st.st_size;
+        if (pc->sizes[f] > 0) {
+            void *map = mmap(NULL, pc->sizes[f], PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) { printf("Could not map %s\n", paths[f]); pc->sizes[f] = 0; }
+            else { pc->maps[f] = map; madvise(map, pc->sizes[f], MADV_SEQUENTIAL); }
+        }
+        close(fd);
+        if (!pc->maps[f]) continue;
+        const char *base = pc->maps[f], *end = base + pc->sizes[f];
+        for (const char *p = base; p < end; ) {
+            const char *q = (size_t)(end - p) > PDN_CHUNK ? pdn_game_start(base, p + PDN_CHUNK, end) : end;
+            if (pc->nchunks == cap) {
+                cap = cap ? 2 * cap : 64;
+                pc->chunks = realloc(pc->chunks, (size_t)cap * sizeof(PDNChunk));
+            }
+            PDNChunk *c = &pc->chunks[pc->nchunks++];
+            memset(c, 0, sizeof(*c));
+            c->begin = p;
+            c->end = q;
+            c->file = f;
+            p = q;
+        }
+    }
+}
+
+static void pdn_close_corpus(PDNCorpus *pc) {
+    for (int f = 0; f < pc->nfiles; ++f) if (pc->maps[f]) munmap((void *)pc->maps[f], pc->sizes[f]);
+    for (int i = 0; i < pc->nchunks; ++i) free(pc->chunks[i].records);
+    free(pc->chunks); free(pc->maps); free(pc->sizes);
+}
+
+/* Replays n chunks on up to `threads` threads (the caller is one). */
+static void pdn_replay(PDNChunk *chunks, int n, int threads) {
+    PDNWork w = { chunks, n, 0 };
+    atomic_init(&w.next, 0);
+    if (threads > n) threads = n > 0 ? n : 1;
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    int started = 0;
+    for (int t = 1; t < threads; ++t)
+        if (pthread_create(&tids[started], NULL, pdn_worker, &w) == 0) started++;
+    pdn_worker(&w);
+    for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+    free(tids);
+}
+
+int pdn_main(int argc, char **argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int max_errors = 20;
+    const char **paths = calloc((size_t)argc + 1, sizeof(char *));
+    int nfiles = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--errors") == 0 && i + 1 < argc) max_errors = atoi(argv[++i]);
+        else paths[nfiles++] = argv[i];
+    }
+    if (nfiles == 0) {
+        printf("usage: pdn [--threads N] [--errors N] <file.pdn>...\n");
+        free(paths);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+
+    PDNCorpus pc;
+    pdn_open_corpus(&pc, paths, nfiles);
+    PDNChunk *chunks = pc.chunks;
+    int nchunks = pc.nchunks;
+    double start = now_seconds();
+    pdn_replay(chunks, nchunks, threads);
+    double secs = now_seconds() - start;
+    if (threads > nchunks) threads = nchunks > 0 ? nchunks : 1;
+
+    /* Chunks are in file order, so line and game numbers are prefix sums. */
+    static const char *KINDS[] = { "illegal move", "bad FEN", "result contradicts final position" };
+    PDNStats total;
+    memset(&total, 0, sizeof(total));
+    unsigned long long line0 = 0, game0 = 0, shown = 0;
+    for (int i = 0; i < nchunks; ++i) {
+        const PDNChunk *c = &chunks[i];
+        if (i == 0 || c->file != chunks[i - 1].file) { line0 = 0; game0 = 0; }
+        for (int e = 0; e < c->nerrors; ++e) {
+            const PDNError *err = &c->errors[e];
+            if ((long long)shown >= max_errors) continue;
+            printf("%s:%llu: game %llu, ply %d: %s %s\n", paths[c->file], line0 + err->line + 1,
+                   game0 + err->game + 1, err->ply, KINDS[err->kind], err->text);
+            shown++;
+        }
+        line0 += c->lines;
+        game0 += c->stats.games;
+        pdn_add_stats(&total, &c->stats);
+    }
+    unsigned long long problems = total.illegal + total.bad_fen + total.mismatches;
+    if (problems > shown) printf("... %llu more problem(s) not listed\n", problems - shown);
+    printf("games %llu, plies %llu, illegal %llu, bad FEN %llu, result mismatches %llu\n",
+           total.games, total.plies, total.illegal, total.bad_fen, total.mismatches);
+    printf("results: red %llu, black %llu, draw %llu, unfinished %llu\n",
+           total.results[PDN_RED_WIN], total.results[PDN_BLACK_WIN],
+           total.results[PDN_DRAW], total.results[PDN_NO_RESULT]);
+    printf("time %.3f s, %.0f games/s, %d thread(s), %d chunk(s)\n", secs,
+           secs > 0 ? (double)total.games / secs : 0.0, threads, nchunks);
+
+    pdn_close_corpus(&pc);
+    free(paths);
+    return problems ? 2 : 0;
+}
+
+/* records convert: PDN games to a record file, in file order.  Chunks are
+   replayed a wave at a time so memory stays bounded by the wave size. */
+static int records_convert(int argc, char **argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int compress = 0, depth = 0;
+    const char *out = NULL;
+    const char **paths = calloc((size_t)argc + 1, sizeof(char *));
+    int nfiles = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--compress") == 0) compress = 1;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out = argv[++i];
+        else paths[nfiles++] = argv[i];
+    }
+    if (!out || nfiles == 0) {
+        printf("usage: records convert [--threads N] [--compress] [--depth N] -o <out.rec> <file.pdn>...\n");
+        free(paths);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    RecWriter *w = rec_writer_open(out, compress);
+    if (!w) { printf("Could not create %s\n", out); free(paths); return 1; }
+
+    PDNCorpus pc;
+    pdn_open_corpus(&pc, paths, nfiles);
+    double start = now_seconds();
+    unsigned long long games = 0, skipped = 0;
+    int wave = 2 * threads;
+    for (int first = 0; first < pc.nchunks; first += wave) {
+        int n = (pc.nchunks - first < wave) ? pc.nchunks - first : wave;
+        PDNChunk *chunks = pc.chunks + first;
+        for (int i = 0; i < n; ++i) { chunks[i].record = 1; chunks[i].score_depth = depth; }
+        pdn_replay(chunks, n, threads);
+        for (int i = 0; i < n; ++i) {
+            PDNChunk *c = &chunks[i];
+            for (size_t k = 0; k < c->nrecords; ++k) rec_write(w, &c->records[k]);
+            games += c->stats.games;
+            skipped += c->stats.illegal + c->stats.bad_fen;
+            free(c->records);
+            c->records = NULL;
+            c->nrecords = c->cap_records = 0;
+        }
+    }
+    unsigned long long count = w->count;
+    int ok = rec_writer_close(w);
+    double secs = now_seconds() - start;
+    pdn_close_corpus(&pc);
+    free(paths);
+    struct stat st;
+    long long bytes = (stat(out, &st) == 0) ? (long long)st.st_size : 0;
+    printf("games %llu (%llu skipped), records %llu, %lld bytes (%.2f bytes/record), %.3f s\n",
+           games, skipped, count, bytes, count ? (double)bytes / (double)count : 0.0, secs);
+    if (!ok) printf("Write error on %s\n", out);
+    return ok ? 0 : 1;
+}
+
+static int records_dump(int argc, char **argv) {
+    if (argc < 1) { printf("usage: records dump <file.rec> [first] [count]\n"); return 1; }
+    RecReader *r = rec_reader_open(argv[0]);
+    if (!r) { printf("Could not open record file %s\n", argv[0]); return 1; }
+    unsigned long long first = argc > 1 ? strtoull(argv[1], NULL, 10) : 0;
+    unsigned long long n = argc > 2 ? strtoull(argv[2], NULL, 10) : 10;
+    static const char *RESULTS[] = { "loss", "draw", "win", "?" };
+    printf("%llu record(s), %s\n", rec_count(r), r->h.block_records ? "compressed" : "uncompressed");
+    for (unsigned long long i = first; i < first + n && i < rec_count(r); ++i) {
+        PosRecord rec;
+        GameState g;
+        char fen[POSITION_STR_LEN];
+        rec_read(r, i, &rec);
+        record_to_gamestate(&rec, &g);
+        format_position(&g, fen);
+        printf("%llu %s %s", i, fen, RESULTS[rec.result & 3]);
+        if (rec.score != REC_NO_SCORE) printf(" %d", rec.score);
+        printf("\n");
+    }
+    rec_reader_close(r);
+    return 0;
+}
+
+int records_main(int argc, char **argv) {
+    if (argc > 0 && strcmp(argv[0], "convert") == 0) return records_convert(argc - 1, argv + 1);
+    if (argc > 0 && strcmp(argv[0], "dump") == 0) return records_dump(argc - 1, argv + 1);
+    printf("usage: records convert|dump ...\n");
+    return 1;
+}
+
+/*
+
+   Monte Carlo tree search
+
+   ./bitboard_checkers mcts [position] [--nodes N] [--time ms] [--threads N] [--mb N] [--scale]
+
+   An alternative to the alpha-beta search for strength experiments.  Every
+   iteration walks down the tree by UCT, adds the children of the leaf it
+   reaches (after that leaf's first playout), plays random legal moves to
+   the end of the game and backs the result up the path.  A win is worth
+   2, a draw 1, counted for the side that made the move into the node.
+   A playout still running after MCTS_PLAYOUT_PLIES is scored a draw.
+   limits->nodes counts playouts.
+
+   Tree parallelism: all threads share one tree.  A thread going down
+   adds a virtual loss (MCTS_VIRTUAL_LOSS visits with no score) to every
+   node it passes, and takes it back in the backup, so the other threads
+   spread out over other lines instead of all following it.  Visits and
+   scores are atomic counters.  A node is expanded by whichever thread
+   flips its state from MCTS_LEAF to MCTS_EXPANDING first; it takes its
+   children's slots from the arena with one compare-and-swap and
+   publishes them by storing MCTS_EXPANDED with release order.  Other
+   threads that reach the node meanwhile play out from it as a leaf.
+
+   Nodes come from an arena (MctsArena) allocated before the search, so
+   nothing is allocated while it runs.  When the arena is full, the tree
+   stops growing and the playouts go on from its leaves.
+
+   With --scale, the same fixed-time search runs with 1, 2, 4, ...
+   threads and prints playouts/s per thread and the scaling against one
+   thread.  Matches take "mcts=1" in an engine config (see match);
+   there "hash" is the arena size.
+
+*/
+
+#define MCTS_VIRTUAL_LOSS   3
+#define MCTS_UCT_C          1.0
+#define MCTS_PLAYOUT_PLIES  200
+#define MCTS_MAX_DEPTH      256
+#define MCTS_MAX_THREADS    64
+#define MCTS_DEFAULT_MB     64
+
+enum { MCTS_LEAF = 0, MCTS_EXPANDING = 1, MCTS_EXPANDED = 2 };
+
+typedef struct {
+    Move move;                   /* from the parent */
+    atomic_uint visits;          /* finished playouts plus virtual losses */
+    atomic_uint score;           /* 2 per win, 1 per draw for the mover */
+    atomic_int state;            /* MCTS_LEAF / EXPANDING / EXPANDED */
+    unsigned int first_child;    /* valid once state is MCTS_EXPANDED */
+    unsigned char nchildren;     /* 0 when expanded: no legal moves */
+} MctsNode;
+
+typedef struct {
+    MctsNode *nodes;
+    unsigned int capacity;
+    atomic_uint used;
+} MctsArena;
+
+typedef struct {
+    int has_move;
+    Move best;
+    double value;                /* score of best per visit, 0..1 */
+    unsigned long long playouts;
+    double seconds;
+    unsigned int tree_nodes;
+    int threads;
+    unsigned long long thread_playouts[MCTS_MAX_THREADS];
+    double thread_seconds[MCTS_MAX_THREADS];
+} MctsResult;
+
+typedef struct {
+    MctsArena *arena;
+    GameState root;
+    const SearchLimits *limits;
+    double deadline;             /* 0 = none */
+    atomic_ullong playouts;
+    atomic_int stop;
+} MctsShared;
+
+typedef struct {
+    MctsShared *shared;
+    int id;
+    unsigned long long seed;
+    unsigned long long playouts;
+    double seconds;
+    pthread_t thread;
+} MctsThread;
+
+static int mcts_arena_init(MctsArena *a, size_t mb) {
+    size_t n = mb * 1024 * 1024 / sizeof(MctsNode);
+    if (n < 1024) n = 1024;
+    if (n > 0xffffffffu) n = 0xffffffffu;
+    a->nodes = malloc(n * sizeof(MctsNode));
+    if (!a->nodes) return 0;
+    a->capacity = (unsigned int)n;
+    atomic_init(&a->used, 0);
+    return 1;
+}
+
+static void mcts_arena_free(MctsArena *a) {
+    free(a->nodes);
+    a->nodes = NULL;
+}
+
+/* Takes n consecutive slots; returns the first, or 0 if the arena is full
+   (slot 0 is always the root). */
+static unsigned int mcts_alloc(MctsArena *a, unsigned int n) {
+    unsigned int first = atomic_load_explicit(&a->used, memory_order_relaxed);
+    do {
+        if (n > a->capacity - first) return 0;
+    } while (!atomic_compare_exchange_weak_explicit(&a->used, &first, first + n,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return first;
+}
+
+static void mcts_node_init(MctsNode *n, const Move *m) {
+    if (m) n->move = *m;
+    atomic_init(&n->visits, 0);
+    atomic_init(&n->score, 0);
+    atomic_init(&n->state, MCTS_LEAF);
+    n->first_child = 0;
+    n->nchildren = 0;
+}
+
+/* Adds the children of node (position g).  Returns 1 if this thread
+   expanded it, 0 if another thread is doing so or the arena is full. */
+static int mcts_expand(MctsArena *a, MctsNode *node, GameState *g) {
+    int expected = MCTS_LEAF;
+    if (!atomic_compare_exchange_strong_explicit(&node->state, &expected, MCTS_EXPANDING,
+                                                 memory_order_acquire, memory_order_relaxed))
+        return 0;
+    Move moves[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    unsigned int first = n ? mcts_alloc(a, (unsigned int)n) : 0;
+    if (n && !first) {
+        atomic_store_explicit(&node->state, MCTS_LEAF, memory_order_relaxed);
+        return 0;
+    }
+    for (int i = 0; i < n; ++i) mcts_node_init(&a->nodes[first + i], &moves[i]);
+    node->first_child = first;
+    node->nchildren = (unsigned char)n;
+    atomic_store_explicit(&node->state, MCTS_EXPANDED, memory_order_release);
+    return 1;
+}
+
+/* The child of an expanded node with the highest UCT value; unvisited
+   children come first. */
+static MctsNode *mcts_select(MctsArena *a, MctsNode *node) {
+    MctsNode *children = &a->nodes[node->first_child];
+    unsigned int parent = atomic_load_explicit(&node->visits, memory_order_relaxed);
+    double log_parent = log((double)(parent + 1));
+    MctsNode *best = &children[0];
+    double best_value = -1.0;
+    for (int i = 0; i < node->nchildren; ++i) {
+        unsigned int v = atomic_load_explicit(&children[i].visits, memory_order_relaxed);
+        if (v == 0) return &children[i];
+        unsigned int w = atomic_load_explicit(&children[i].score, memory_order_relaxed);
+        double value = w / (2.0 * v) + MCTS_UCT_C * sqrt(log_parent / v);
+        if (value > best_value) { best_value = value; best = &children[i]; }
+    }
+    return best;
+}
+
+/* Random game from g; returns the winner (0 red, 1 black) or -1 for a draw. */
+static int mcts_playout(GameState *g, unsigned long long *seed) {
+    Move moves[MAX_MOVES];
+    for (int ply = 0; ply < MCTS_PLAYOUT_PLIES; ++ply) {
+        int n = generate_moves(g, g->turn, moves);
+        if (n == 0) return 1 - g->turn;
+        apply_move(g, &moves[splitmix64(seed) % (unsigned long long)n]);
+    }
+    return -1;
+}
+
+/* One select / expand / playout / backup pass. */
+static void mcts_iterate(MctsShared *sh, unsigned long long *seed) {
+    MctsArena *a = sh->arena;
+    MctsNode *path[MCTS_MAX_DEPTH + 2];
+    int movers[MCTS_MAX_DEPTH + 2];
+    GameState g = sh->root;
+    int depth = 0;
+    MctsNode *node = &a->nodes[0];
+    path[0] = node;
+    movers[0] = 1 - g.turn;
+    while (depth < MCTS_MAX_DEPTH &&
+           atomic_load_explicit(&node->state, memory_order_acquire) == MCTS_EXPANDED && node->nchildren) {
+        node = mcts_select(a, node);
+        atomic_fetch_add_explicit(&node->visits, MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+        movers[++depth] = g.turn;
+        path[depth] = node;
+        apply_move(&g, &node->move);
+    }
+    /* A leaf is expanded once it has had a playout, and one child is
+       played out at random. */
+    if (depth < MCTS_MAX_DEPTH &&
+        atomic_load_explicit(&node->visits, memory_order_relaxed) > MCTS_VIRTUAL_LOSS &&
+        mcts_expand(a, node, &g) && node->nchildren) {
+        node = &a->nodes[node->first_child + splitmix64(seed) % node->nchildren];
+        atomic_fetch_add_explicit(&node->visits, MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+        movers[++depth] = g.turn;
+        path[depth] = node;
+        apply_move(&g, &node->move);
+    }
+    int winner = mcts_playout(&g, seed);
+    for (int d = depth; d >= 0; --d) {
+        unsigned int points = winner < 0 ? 1u : (winner == movers[d] ? 2u : 0u);
+        atomic_fetch_add_explicit(&path[d]->score, points, memory_order_relaxed);
+        if (d) atomic_fetch_sub_explicit(&path[d]->visits, MCTS_VIRTUAL_LOSS - 1, memory_order_relaxed);
+        else atomic_fetch_add_explicit(&path[d]->visits, 1u, memory_order_relaxed);
+    }
+}
+
+static void *mcts_thread_main(void *arg) {
+    MctsThread *t = (MctsThread *)arg;
+    MctsShared *sh = t->shared;
+    unsigned long long limit = sh->limits->nodes;
+    double start = now_seconds();
+    while (!atomic_load_explicit(&sh->stop, memory_order_relaxed)) {
+        if (limit && atomic_fetch_add_explicit(&sh->playouts, 1, memory_order_relaxed) >= limit) break;
+        mcts_iterate(sh, &t->seed);
+        t->playouts++;
+        if (!(t->playouts & 15)) {
+            if (sh->deadline > 0 && now_seconds() >= sh->deadline) break;
+            if (sh->limits->stop_flag && atomic_load(sh->limits->stop_flag)) break;
+        }
+    }
+    atomic_store(&sh->stop, 1);
+    t->seconds = now_seconds() - start;
+    return NULL;
+}
+
+/* Searches pos until limits->nodes playouts, limits->movetime_ms or
+   limits->stop_flag, on limits->threads threads.  The arena is reset;
+   the best move is the most visited root child. */
+void mcts_search(const GameState *pos, const SearchLimits *limits, MctsArena *arena, MctsResult *out) {
+    memset(out, 0, sizeof(*out));
+    MctsShared sh;
+    sh.arena = arena;
+    sh.root = *pos;
+    sh.limits = limits;
+    atomic_init(&sh.playouts, 0ULL);
+    atomic_init(&sh.stop, 0);
+    atomic_store(&arena->used, 1);
+    MctsNode *root = &arena->nodes[0];
+    mcts_node_init(root, NULL);
+    GameState g = *pos;
+    mcts_expand(arena, root, &g);
+    if (root->nchildren == 0) return;
+    out->has_move = 1;
+    out->best = arena->nodes[root->first_child].move;
+
+    int nthreads = limits->threads < 1 ? 1 : limits->threads > MCTS_MAX_THREADS ? MCTS_MAX_THREADS : limits->threads;
+    MctsThread threads[MCTS_MAX_THREADS];
+    double start = now_seconds();
+    sh.deadline = limits->movetime_ms > 0 ? start + limits->movetime_ms / 1000.0 : 0.0;
+    if (!limits->nodes && !sh.deadline && !limits->stop_flag) sh.deadline = start + 1.0;
+    int started = 1;
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i].shared = &sh;
+        threads[i].id = i;
+        threads[i].seed = 0x9E3779B97F4A7C15ULL * (unsigned long long)(i + 1) ^ pos->red_man ^ pos->blk_man;
+        threads[i].playouts = 0ULL;
+        threads[i].seconds = 0.0;
+    }
+    for (int i = 1; i < nthreads; ++i) {
+        if (pthread_create(&threads[started].thread, NULL, mcts_thread_main, &threads[started]) != 0) break;
+        started++;
+    }
+    mcts_thread_main(&threads[0]);
+    for (int i = 1; i < started; ++i) pthread_join(threads[i].thread, NULL);
+    out->seconds = now_seconds() - start;
+
+    out->threads = started;
+    for (int i = 0; i < started; ++i) {
+        out->thread_playouts[i] = threads[i].playouts;
+        out->thread_seconds[i] = threads[i].seconds;
+        out->playouts += threads[i].playouts;
+    }
+    const MctsNode *children = &arena->nodes[root->first_child];
+    unsigned int best_visits = 0;
+    for (int i = 0; i < root->nchildren; ++i) {
+        unsigned int v = atomic_load(&children[i].visits);
+        if (v > best_visits) {
+            best_visits = v;
+            out->best = children[i].move;
+            out->value = atomic_load(&children[i].score) / (2.0 * v);
+        }
+    }
+    unsigned int used = atomic_load(&arena->used);
+    out->tree_nodes = used < arena->capacity ? used : arena->capacity;
+}
+
+static void mcts_print_root(const MctsArena *arena, int max_lines) {
+    const MctsNode *root = &arena->nodes[0];
+    const MctsNode *children = &arena->nodes[root->first_child];
+    int order[MAX_MOVES];
+    int n = root->nchildren;
+    for (int i = 0; i < n; ++i) order[i] = i;
+    for (int i = 1; i < n; ++i) {
+        int k = order[i], j = i;
+        while (j > 0 && atomic_load(&children[order[j - 1]].visits) < atomic_load(&children[k].visits)) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = k;
+    }
+    for (int i = 0; i < n && i < max_lines; ++i) {
+        const MctsNode *c = &children[order[i]];
+        unsigned int v = atomic_load(&c->visits);
+        char buf[MOVE_STR_LEN];
+        move_to_string(&c->move, buf);
+        printf("  %-12s %10u visits  %5.1f%%\n", buf, v, v ? 100.0 * atomic_load(&c->score) / (2.0 * v) : 0.0);
+    }
+}
+
+int mcts_main(int argc, char **argv) {
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    const char *pos = "startpos";
+    size_t mb = MCTS_DEFAULT_MB;
+    int scale = 0;
+    for (int i = 0; i < argc; ) {
+        int used = parse_limit_arg(argc - i, argv + i, &limits);
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--mb") == 0 && i + 1 < argc) { mb = (size_t)atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--scale") == 0) { scale = 1; i++; continue; }
+        pos = argv[i++];
+    }
+    if (!limits.nodes && !limits.movetime_ms) limits.movetime_ms = scale ? 2000 : 1000;
+    if (limits.threads > MCTS_MAX_THREADS) limits.threads = MCTS_MAX_THREADS;
+    GameState g;
+    if (!parse_position(pos, &g)) { printf("Bad position.\n"); return 1; }
+    MctsArena arena;
+    if (!mcts_arena_init(&arena, mb)) { printf("Could not allocate %zu MB.\n", mb); return 1; }
+    MctsResult r;
+
+    if (scale) {
+        int max_threads = limits.threads > 1 ? limits.threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (max_threads > MCTS_MAX_THREADS) max_threads = MCTS_MAX_THREADS;
+        printf("MCTS scaling: %d ms per run, arena %u nodes, %d core(s) online\n",
+               limits.movetime_ms, arena.capacity, (int)sysconf(_SC_NPROCESSORS_ONLN));
+        printf("threads     playouts   playouts/s  per-thread/s    scale  efficiency\n");
+        double base = 0.0;
+        for (int threads = 1; ; threads *= 2) {
+            if (threads > max_threads) threads = max_threads;
+            limits.threads = threads;
+            mcts_search(&g, &limits, &arena, &r);
+            double pps = r.seconds > 0 ? r.playouts / r.seconds : 0.0;
+            if (threads == 1) base = pps;
+            printf("%7d %12llu %12.0f %13.0f %8.2f %10.0f%%\n", threads, r.playouts, pps, pps / r.threads,
+                   base > 0 ? pps / base : 0.0, base > 0 ? 100.0 * pps / base / r.threads : 0.0);
+            fflush(stdout);
+            if (threads == max_threads) break;
+        }
+        mcts_arena_free(&arena);
+        return 0;
+    }
+
+    mcts_search(&g, &limits, &arena, &r);
+    if (!r.has_move) { printf("bestmove none\n"); mcts_arena_free(&arena); return 0; }
+    mcts_print_root(&arena, 8);
+    printf("%llu playouts in %.3f s (%.0f/s), %u tree nodes (%u%% of the arena)\n", r.playouts, r.seconds,
+           r.seconds > 0 ? r.playouts / r.seconds : 0.0, r.tree_nodes,
+           (unsigned int)((unsigned long long)r.tree_nodes * 100 / arena.capacity));
+    for (int i = 0; i < r.threads; ++i)
+        printf("  thread %d: %llu playouts, %.0f/s\n", i, r.thread_playouts[i],
+               r.thread_seconds[i] > 0 ? r.thread_playouts[i] / r.thread_seconds[i] : 0.0);
+    char buf[MOVE_STR_LEN];
+    move_to_string(&r.best, buf);
+    printf("bestmove %s value %.3f\n", buf, r.value);
+    mcts_arena_free(&arena);
+    return 0;
+}
+
+/*
+
+   Self-play matches
+
+   ./bitboard_checkers match [--games N] [--threads N] [--openings file]
+                             [--a config] [--b config] [--maxply N]
+                             [--sprt elo0 elo1] [--pdn file] [--records file]
+
+   Plays engine configuration A against B on a pool of threads.  An
+   engine configuration is a comma list such as "depth=8,hash=8" or
+   "nodes=20000" (depth, nodes, time in ms, hash in MB; mcts=1 plays
+   with Monte Carlo tree search instead, nodes then counting playouts
+   and hash sizing its arena).  Openings come
+   one per line from the file, as a position string or as moves from the
+   start position; by default every two-ply opening is used.  Games 2k
+   and 2k+1 play opening k with colours swapped.
+
+   Every finished game is printed (and appended to --pdn / --records)
+   straight away with the running score, the Elo difference of A with a
+   95% error bar and, with --sprt, the log-likelihood ratio of H1 (elo1)
+   against H0 (elo0) at alpha = beta = 0.05; the match stops once it
+   crosses a bound.  A game that reaches --maxply plies (default 300),
+   or repeats a position three times, is a draw.
+
+*/
+
+#define MATCH_MAX_OPENINGS 4096
+#define MATCH_MAX_PLY      512
+
+typedef struct {
+    SearchLimits limits;
+    size_t hash_mb;
+    int mcts;                        /* Monte Carlo tree search instead of alpha-beta */
+} EngineConfig;
+
+/* "depth=8,nodes=0,time=0,hash=8"; returns 0 on an unknown key. */
+static int parse_engine_config(const char *s, EngineConfig *cfg) {
+    while (*s) {
+        const char *eq = strchr(s, '=');
+        if (!eq) return 0;
+        size_t len = (size_t)(eq - s);
+        long long v = strtoll(eq + 1, NULL, 10);
+        if (len == 5 && strncmp(s, "depth", 5) == 0) cfg->limits.depth = (int)v;
+        else if (len == 5 && strncmp(s, "nodes", 5) == 0) cfg->limits.nodes = (unsigned long long)v;
+        else if (len == 4 && strncmp(s, "time", 4) == 0) cfg->limits.movetime_ms = (int)v;
+        else if (len == 4 && strncmp(s, "hash", 4) == 0) cfg->hash_mb = (size_t)v;
+        else if (len == 4 && strncmp(s, "mcts", 4) == 0) cfg->mcts = v != 0;
+        else return 0;
+        const char *comma = strchr(eq, ',');
+        s = comma ? comma + 1 : eq + strlen(eq);
+    }
+    return 1;
+}
+
+typedef struct {
+    EngineConfig cfg[2];             /* A, B */
+    GameState *openings;
+    int nopenings;
+    int games;
+    int maxply;
+    atomic_int next;
+    atomic_int stop;
+    /* Everything below is guarded by lock. */
+    pthread_mutex_t lock;
+    int played;
+    int wins, draws, losses;         /* from A's point of view */
+    int sprt;
+    double elo0, elo1;
+    FILE *pdn;
+    RecWriter *records;
+    double start;
+    int threads;
+} Match;
+
+/* Score of A as a probability and its per-game variance. */
+static void match_score(const Match *m, double *score, double *var) {
+    double n = m->wins + m->draws + m->losses;
+    double s = (m->wins + 0.5 * m->draws) / n;
+    *score = s;
+    *var = (m->wins * (1 - s) * (1 - s) + m->draws * (0.5 - s) * (0.5 - s) + m->losses * s * s) / n;
+}
+
+static double elo_from_score(double s) {
+    if (s <= 0.0) return -999.0;
+    if (s >= 1.0) return 999.0;
+    return -400.0 * log10(1.0 / s - 1.0);
+}
+
+/* Log-likelihood ratio of elo1 against elo0 (normal approximation). */
+static double match_llr(const Match *m) {
+    double s, var;
+    match_score(m, &s, &var);
+    if (var <= 0.0) return 0.0;
+    double s0 = 1.0 / (1.0 + pow(10.0, -m->elo0 / 400.0));
+    double s1 = 1.0 / (1.0 + pow(10.0, -m->elo1 / 400.0));
+    double n = m->wins + m->draws + m->losses;
+    return n * (s1 - s0) * (2 * s - s0 - s1) / (2 * var);
+}
+
+/* Plays one game from `start` with engine A on side a_side; returns the
+   PDN_* result and fills moves, recs (labelled) and *plies. */
+static int match_play(Match *m, TransTable tt[2], MctsArena arena[2], const GameState *start, int a_side,
+                      Move *moves, PosRecord *recs, int *plies) {
+    GameState g = *start;
+    unsigned long long keys[MATCH_MAX_PLY + 1];
+    int ply = 0;
+    int result = PDN_DRAW;
+    for (int e = 0; e < 2; ++e) if (!m->cfg[e].mcts) tt_clear(&tt[e]);
+    keys[0] = g.key;
+    while (1) {
+        Move list[MAX_MOVES];
+        if (generate_moves(&g, g.turn, list) == 0) { result = (g.turn == 0) ? PDN_BLACK_WIN : PDN_RED_WIN; break; }
+        if (ply >= m->maxply || ply >= MATCH_MAX_PLY) break;
+        int reps = 0;
+        for (int i = ply - 2; i >= 0; i -= 2) if (keys[i] == g.key) reps++;
+        if (reps >= 2) break;
+        int engine = (g.turn == a_side) ? 0 : 1;
+        Move best;
+        int score;
+        if (m->cfg[engine].mcts) {
+            MctsResult r;
+            mcts_search(&g, &m->cfg[engine].limits, &arena[engine], &r);
+            best = r.best;
+            score = REC_NO_SCORE;                       /* a win rate, not an evaluation */
+        } else {
+            SearchResult r;
+            search_position(&g, &m->cfg[engine].limits, &tt[engine], &r, 0);
+            best = r.best;
+            score = r.score;
+        }
+        record_from_gamestate(&g, REC_UNKNOWN, score, &recs[ply]);
+        moves[ply++] = best;
+        apply_move(&g, &best);
+        keys[ply] = g.key;
+    }
+    for (int i = 0; i < ply; ++i) {
+        if (result == PDN_DRAW) recs[i].result = REC_DRAW;
+        else recs[i].result = ((result == PDN_RED_WIN) == (recs[i].turn == 0)) ? REC_WIN : REC_LOSS;
+    }
+    *plies = ply;
+    return result;
+}
+
+static void match_write_pdn(Match *m, int game, int opening, int a_side, const GameState *start,
+                            const Move *moves, int plies, int result) {
+    static const char *RESULT[] = { "1-0", "0-1", "1/2-1/2" };
+    char fen[POSITION_STR_LEN];
+    GameState pos = *start;
+    format_position(&pos, fen);
+    fprintf(m->pdn, "[Event \"match\"]\n[Round \"%d\"]\n[Black \"%s\"]\n[White \"%s\"]\n"
+            "[Opening \"%d\"]\n[FEN \"%s\"]\n[Result \"%s\"]\n",
+            game + 1, a_side == 0 ? "A" : "B", a_side == 0 ? "B" : "A", opening + 1, fen, RESULT[result]);
+    int col = 0;
+    for (int i = 0; i < plies; ++i) {
+        char buf[MOVE_STR_LEN];
+        move_to_string(&moves[i], buf);
+        if ((start->turn + i) % 2 == 0 || i == 0)
+            col += fprintf(m->pdn, "%d%s ", (start->turn + i) / 2 + 1, (start->turn + i) % 2 ? "..." : ".");
+        col += fprintf(m->pdn, "%s ", buf);
+        if (col > 72) { fputc('\n', m->pdn); col = 0; }
+    }
+    fprintf(m->pdn, "%s\n\n", RESULT[result]);
+    fflush(m->pdn);
+}
+
+static void *match_worker(void *arg) {
+    Match *m = (Match *)arg;
+    TransTable tt[2];
+    MctsArena arena[2];
+    memset(tt, 0, sizeof(tt));
+    memset(arena, 0, sizeof(arena));
+    int ok = 1;
+    for (int e = 0; e < 2 && ok; ++e)
+        ok = m->cfg[e].mcts ? mcts_arena_init(&arena[e], m->cfg[e].hash_mb) : tt_init(&tt[e], m->cfg[e].hash_mb);
+    if (!ok) {
+        printf("Could not allocate hash tables.\n");
+        atomic_store(&m->stop, 1);
+        tt_free(&tt[0]);
+        tt_free(&tt[1]);
+        mcts_arena_free(&arena[0]);
+        mcts_arena_free(&arena[1]);
+        return NULL;
+    }
+    Move moves[MATCH_MAX_PLY];
+    PosRecord recs[MATCH_MAX_PLY];
+    int game;
+    while (!atomic_load(&m->stop) && (game = atomic_fetch_add(&m->next, 1)) < m->games) {
+        int opening = (game / 2) % m->nopenings;
+        int a_side = game & 1;                       /* A is red in even games */
+        int plies;
+        const GameState *start = &m->openings[opening];
+        int result = match_play(m, tt, arena, start, a_side, moves, recs, &plies);
+
+        pthread_mutex_lock(&m->lock);
+        int a_result = (result == PDN_DRAW) ? 1 : ((result == PDN_RED_WIN) == (a_side == 0)) ? 2 : 0;
+        if (a_result == 2) m->wins++;
+        else if (a_result == 1) m->draws++;
+        else m->losses++;
+        m->played++;
+        if (m->pdn) match_write_pdn(m, game, opening, a_side, start, moves, plies, result);
+        if (m->records) for (int i = 0; i < plies; ++i) rec_write(m->records, &recs[i]);
+        double s, var;
+        match_score(m, &s, &var);
+        double margin = 1.96 * sqrt(var / m->played);
+        double elo = elo_from_score(s);
+        double lo = elo_from_score(s - margin), hi = elo_from_score(s + margin);
+        printf("game %d opening %d %s %s plies %d  +%d -%d =%d  elo %+.1f (%+.1f, %+.1f)",
+               game + 1, opening + 1, a_side == 0 ? "A-B" : "B-A",
+               result == PDN_DRAW ? "1/2-1/2" : result == PDN_RED_WIN ? "1-0" : "0-1",
+               plies, m->wins, m->losses, m->draws, elo, lo, hi);
+        if (m->sprt) {
+            double llr = match_llr(m);
+            double bound = log((1 - 0.05) / 0.05);
+            printf("  llr %.2f (%.2f, %.2f)", llr, -bound, bound);
+            if (llr >= bound || llr <= -bound) {
+                if (!atomic_exchange(&m->stop, 1))
+                    printf("\nSPRT: %s accepted", llr >= bound ? "H1 (elo1)" : "H0 (elo0)");
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+        pthread_mutex_unlock(&m->lock);
+    }
+    tt_free(&tt[0]);
+    tt_free(&tt[1]);
+    mcts_arena_free(&arena[0]);
+    mcts_arena_free(&arena[1]);
+    return NULL;
+}
+
+/* One line of an openings or position file: a position string or a
+   move list from the start position.  Returns 1 and fills *g, 0 if the
+   line is malformed or has an illegal move, -1 if it is blank or a
+   '#' comment. */
+static int parse_opening_line(const char *line, GameState *g) {
+    const char *p = line;
+    size_t len;
+    const char *tok = next_token(&p, &len);
+    if (!len || tok[0] == '#') return -1;
+    int is_position = token_is(tok, len, "startpos") || memchr(tok, ':', len) != NULL;
+    if (is_position && parse_position(tok, g)) return 1;
+    init_game(g);
+    p = line;
+    while (tok = next_token(&p, &len), len) {
+        Move mv;
+        if (!parse_move_string(g, tok, len, &mv)) return 0;
+        apply_move(g, &mv);
+    }
+    return 1;
+}
+
+/* Openings from a file: one position string or start-position move list
+   per line; blank lines and lines starting with '#' are skipped. */
+static int load_openings(const char *path, GameState *out, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[1024];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        GameState g;
+        int r = parse_opening_line(line, &g);
+        if (r > 0) out[n++] = g;
+        else if (r == 0) printf("Skipping bad opening: %s", line);
+    }
+    fclose(f);
+    return n;
+}
+
+int match_main(int argc, char **argv) {
+    static Match m;
+    memset(&m, 0, sizeof(m));
+    EngineConfig def = { SEARCH_LIMITS_DEFAULT, 8, 0 };
+    def.limits.nodes = 5000ULL;
+    m.cfg[0] = m.cfg[1] = def;
+    m.games = 100;
+    m.maxply = 300;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *openings = NULL, *pdn = NULL, *records = NULL;
+    for (int i = 0; i < argc; ++i) {
+        int more = i + 1 < argc;
+        if (strcmp(argv[i], "--games") == 0 && more) m.games = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && more) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--openings") == 0 && more) openings = argv[++i];
+        else if (strcmp(argv[i], "--maxply") == 0 && more) m.maxply = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pdn") == 0 && more) pdn = argv[++i];
+        else if (strcmp(argv[i], "--records") == 0 && more) records = argv[++i];
+        else if ((strcmp(argv[i], "--a") == 0 || strcmp(argv[i], "--b") == 0) && more) {
+            EngineConfig *cfg = &m.cfg[argv[i][2] == 'b'];
+            *cfg = def;
+            cfg->limits.nodes = 0;
+            if (!parse_engine_config(argv[++i], cfg)) { printf("Bad engine config %s\n", argv[i]); return 1; }
+            if (!cfg->limits.depth && !cfg->limits.nodes && !cfg->limits.movetime_ms) cfg->limits.nodes = def.limits.nodes;
+        } else if (strcmp(argv[i], "--sprt") == 0 && i + 2 < argc) {
+            m.sprt = 1;
+            m.elo0 = atof(argv[++i]);
+            m.elo1 = atof(argv[++i]);
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    m.openings = calloc(MATCH_MAX_OPENINGS, sizeof(GameState));
+    if (openings) {
+        m.nopenings = load_openings(openings, m.openings, MATCH_MAX_OPENINGS);
+        if (m.nopenings < 0) { printf("Could not open %s\n", openings); free(m.openings); return 1; }
+    } else {
+        GameState g;
+        Move first[MAX_MOVES], second[MAX_MOVES];
+        init_game(&g);
+        int n1 = generate_moves(&g, g.turn, first);
+        for (int i = 0; i < n1; ++i) {
+            Undo u1, u2;
+            make_move(&g, &first[i], &u1);
+            int n2 = generate_moves(&g, g.turn, second);
+            for (int j = 0; j < n2 && m.nopenings < MATCH_MAX_OPENINGS; ++j) {
+                make_move(&g, &second[j], &u2);
+                m.openings[m.nopenings++] = g;
+                unmake_move(&g, &u2);
+            }
+            unmake_move(&g, &u1);
+        }
+    }
+    if (m.nopenings == 0) { printf("No openings.\n"); free(m.openings); return 1; }
+    if (pdn && !(m.pdn = fopen(pdn, "a"))) { printf("Could not open %s\n", pdn); return 1; }
+    if (records && !(m.records = rec_writer_open(records, 1))) { printf("Could not create %s\n", records); return 1; }
+    pthread_mutex_init(&m.lock, NULL);
+    atomic_init(&m.next, 0);
+    atomic_init(&m.stop, 0);
+    if (threads > m.games) threads = m.games > 0 ? m.games : 1;
+    m.threads = threads;
+
+    printf("match: %d games, %d opening(s), %d thread(s)\n", m.games, m.nopenings, threads);
+    m.start = now_seconds();
+    pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+    int started = 0;
+    for (int t = 1; t < threads; ++t)
+        if (pthread_create(&tids[started], NULL, match_worker, &m) == 0) started++;
+    match_worker(&m);
+    for (int t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+    double secs = now_seconds() - m.start;
+
+    if (m.played) {
+        double s, var;
+        match_score(&m, &s, &var);
+        printf("A vs B: +%d -%d =%d, score %.1f%%, elo %+.1f +- %.1f\n", m.wins, m.losses, m.draws,
+               100.0 * s, elo_from_score(s),
+               (elo_from_score(s + 1.96 * sqrt(var / m.played)) - elo_from_score(s - 1.96 * sqrt(var / m.played))) / 2);
+    }
+    printf("%d game(s) in %.1f s, %.1f games/min/core\n", m.played, secs,
+           secs > 0 ? 60.0 * m.played / secs / threads : 0.0);
+    if (m.pdn) fclose(m.pdn);
+    int ok = m.records ? rec_writer_close(m.records) : 1;
+    free(tids);
+    free(m.openings);
+    pthread_mutex_destroy(&m.lock);
+    return ok ? 0 : 1;
+}
+
+/*
+
+   Proof-number solver
+
+   ./bitboard_checkers solve [--mb N] [--maxply N] [--time ms] [--tb file] [--file f] [position]...
+
+   Depth-first proof-number search (df-pn) for shots and won endings.
+   One run tries to prove that a given side, the attacker, wins.  At the
+   attacker's nodes one winning move is enough: the proof number is the
+   minimum over the children and the disproof number their sum.  At the
+   defender's nodes every move has to lose, which is the other way round.
+   A new node starts with its legal move count as the cost of disproving
+   it (attacker to move) or proving it (defender to move).  Captures are
+   mandatory, so a defender who has to take is a node with one or two
+   children, and forcing lines are searched first.
+
+   A position is solved in up to two runs.  If the side to move wins, it is
+   a win.  Otherwise, if the opponent wins, it is a loss.  Otherwise it is
+   a draw if neither run met a repetition or the ply horizon, "no win
+   found" if a repetition was met and "unknown" if the horizon cut either
+   run.  A repetition on the current path does not count as a win.  With
+   --tb, tablebase positions are leaves.
+
+   Entries are keyed by position alone, so a disproof that came from a
+   repetition or the horizon is reused at other depths (the graph
+   history interaction).  That can only hide a win, never invent one:
+   wins and losses are proofs, and a draw is only claimed when no such
+   disproof took part in either run.
+
+   Nodes live in their own table (DfpnTable), not in the search's hash
+   table.  The table holds 24-byte entries in buckets of four, keyed by
+   the Zobrist key and the attacker.  Once three quarters of it is in use,
+   the entries with the least work below them (the smallest subtrees)
+   are garbage collected until at least half of the used entries are
+   gone.
+
+*/
+
+#define DFPN_INF       100000000u
+#define DFPN_BUCKET    4
+#define DFPN_MAX_PLY   256
+#define DFPN_ATTACKER_KEY 0x5bd1e9955bd1e995ULL
+
+typedef struct {
+    unsigned long long key;      /* 0 = empty */
+    unsigned int pn, dn;
+    unsigned int work;           /* nodes expanded below it, saturating */
+} DfpnEntry;
+
+_Static_assert(sizeof(DfpnEntry) == 24, "DfpnEntry must stay 24 bytes");
+
+typedef struct {
+    DfpnEntry *entries;
+    size_t buckets;              /* power of two */
+    size_t used;
+    unsigned long long gc_runs;
+    unsigned long long gc_freed;
+} DfpnTable;
+
+typedef struct {
+    DfpnTable *table;
+    int attacker;
+    int max_ply;
+    double deadline;             /* 0 = none */
+    int stop;
+    int horizon;                 /* a leaf was cut by max_ply */
+    int repetition;              /* a leaf was disproved by a repetition */
+    unsigned long long nodes;    /* expanded */
+    unsigned long long path[DFPN_MAX_PLY + 1];   /* keys, for repetitions */
+} DfpnSolver;
+
+static int dfpn_table_init(DfpnTable *t, size_t mb) {
+    size_t want = mb * 1024 * 1024 / (sizeof(DfpnEntry) * DFPN_BUCKET);
+    size_t buckets = 1;
+    while (buckets * 2 <= want) buckets *= 2;
+    memset(t, 0, sizeof(*t));
+    t->entries = calloc(buckets * DFPN_BUCKET, sizeof(DfpnEntry));
+    if (!t->entries) return 0;
+    t->buckets = buckets;
+    return 1;
+}
+
+static void dfpn_table_clear(DfpnTable *t) {
+    memset(t->entries, 0, t->buckets * DFPN_BUCKET * sizeof(DfpnEntry));
+    t->used = 0;
+}
+
+static unsigned long long dfpn_key(const DfpnSolver *s, const GameState *g) {
+    return (g->key ^ (s->attacker ? DFPN_ATTACKER_KEY : 0ULL)) | 1ULL;
+}
+
+/* Bit 0 of a key is always set, so buckets are picked from the rest. */
+static DfpnEntry *dfpn_bucket(DfpnTable *t, unsigned long long key) {
+    return &t->entries[((size_t)(key >> 1) & (t->buckets - 1)) * DFPN_BUCKET];
+}
+
+static DfpnEntry *dfpn_lookup(DfpnTable *t, unsigned long long key) {
+    DfpnEntry *b = dfpn_bucket(t, key);
+    for (int i = 0; i < DFPN_BUCKET; ++i) {
+        if (b[i].key == key) return &b[i];
+    }
+    return NULL;
+}
+
+/* Frees the entries with the smallest subtrees: work is bucketed by bit
+   length and whole buckets go, smallest first, until at least half of
+   the used entries are free. */
+static void dfpn_gc(DfpnTable *t) {
+    size_t n = t->buckets * DFPN_BUCKET;
+    size_t hist[33] = { 0 };
+    for (size_t i = 0; i < n; ++i) {
+        if (t->entries[i].key) hist[32 - (t->entries[i].work ? __builtin_clz(t->entries[i].work) : 32)]++;
+    }
+    int limit = 0;
+    size_t freed = hist[0];
+    while (limit < 32 && freed < t->used / 2) freed += hist[++limit];
+    for (size_t i = 0; i < n; ++i) {
+        DfpnEntry *e = &t->entries[i];
+        if (e->key && 32 - (e->work ? __builtin_clz(e->work) : 32) <= limit) {
+            e->key = 0;
+            t->used--;
+        }
+    }
+    t->gc_runs++;
+    t->gc_freed += freed;
+}
+
+static void dfpn_store(DfpnTable *t, unsigned long long key, unsigned int pn, unsigned int dn,
+                       unsigned long long work) {
+    if (t->used >= t->buckets * DFPN_BUCKET / 4 * 3) dfpn_gc(t);
+    DfpnEntry *b = dfpn_bucket(t, key);
+    DfpnEntry *e = NULL;
+    for (int i = 0; i < DFPN_BUCKET && !e; ++i) {
+        if (b[i].key == key) e = &b[i];
+    }
+    for (int i = 0; i < DFPN_BUCKET && !e; ++i) {
+        if (!b[i].key) { e = &b[i]; t->used++; }
+    }
+    if (!e) {
+        /* Bucket full before a GC was due: replace its smallest subtree. */
+        e = &b[0];
+        for (int i = 1; i < DFPN_BUCKET; ++i) if (b[i].work < e->work) e = &b[i];
+    }
+    e->key = key;
+    e->pn = pn;
+    e->dn = dn;
+    e->work = work > 0xffffffffULL ? 0xffffffffu : (unsigned int)work;
+}
+
+/* Value of the node at ply if it needs no search: a repetition, no legal
+   moves, a tablebase hit or the horizon.  Returns 1 and sets the exact
+   numbers, or 0 with the starting estimate from the move count. */
+static int dfpn_leaf(DfpnSolver *s, GameState *g, int ply, unsigned int *pn, unsigned int *dn) {
+    int attacker_moves = (g->turn == s->attacker);
+    for (int p = ply - 2; p >= 0; p -= 2) {
+        if (s->path[p] == g->key) {
+            s->repetition = 1;
+            *pn = DFPN_INF;
+            *dn = 0;
+            return 1;
+        }
+    }
+    Move moves[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    if (n == 0) {
+        *pn = attacker_moves ? DFPN_INF : 0;
+        *dn = attacker_moves ? 0 : DFPN_INF;
+        return 1;
+    }
+    if (active_tb) {
+        int dist;
+        int v = tb_probe(active_tb, g, &dist);
+        if (v != TB_UNKNOWN) {
+            int won = attacker_moves ? v == TB_WIN : v == TB_LOSS;
+            *pn = won ? 0 : DFPN_INF;
+            *dn = won ? DFPN_INF : 0;
+            return 1;
+        }
+    }
+    if (ply >= s->max_ply) {
+        s->horizon = 1;
+        *pn = DFPN_INF;
+        *dn = 0;
+        return 1;
+    }
+    *pn = attacker_moves ? 1 : (unsigned int)n;
+    *dn = attacker_moves ? (unsigned int)n : 1;
+    return 0;
+}
+
+/* Sums stop just short of DFPN_INF: transpositions in king endings
+   count subtrees many times over, and a saturated sum must not read as
+   a proof or disproof. */
+static unsigned int dfpn_add(unsigned int a, unsigned int b) {
+    if (a >= DFPN_INF || b >= DFPN_INF) return DFPN_INF;
+    return (a >= DFPN_INF - 1 - b) ? DFPN_INF - 1 : a + b;
+}
+
+/* Expands g (at ply, with moves) until its proof number reaches thpn or
+   its disproof number reaches thdn, then stores it.  Returns the number
+   of nodes expanded. */
+static unsigned long long dfpn_mid(DfpnSolver *s, GameState *g, int ply, unsigned int thpn, unsigned int thdn,
+                                   unsigned int *pn_out, unsigned int *dn_out) {
+    s->nodes++;
+    if (!(s->nodes & 1023) && s->deadline > 0 && now_seconds() >= s->deadline) s->stop = 1;
+    int or_node = (g->turn == s->attacker);
+    Move moves[MAX_MOVES];
+    unsigned long long keys[MAX_MOVES];
+    unsigned int cpn[MAX_MOVES], cdn[MAX_MOVES];
+    unsigned char exact[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    for (int i = 0; i < n; ++i) {
+        Undo u;
+        make_move(g, &moves[i], &u);
+        s->path[ply + 1] = g->key;
+        exact[i] = (unsigned char)dfpn_leaf(s, g, ply + 1, &cpn[i], &cdn[i]);
+        keys[i] = dfpn_key(s, g);
+        unmake_move(g, &u);
+    }
+
+    unsigned long long work = 1;
+    unsigned int pn, dn;
+    while (1) {
+        /* OR node: pn = min, dn = sum; AND node the other way round.
+           "sel" is the number the best child is chosen by. */
+        int best = 0;
+        unsigned int min1 = DFPN_INF, min2 = DFPN_INF, sum = 0;
+        for (int i = 0; i < n; ++i) {
+            if (!exact[i]) {
+                const DfpnEntry *e = dfpn_lookup(s->table, keys[i]);
+                if (e) {
+                    cpn[i] = e->pn;
+                    cdn[i] = e->dn;
+                }
+            }
+            unsigned int sel = or_node ? cpn[i] : cdn[i];
+            sum = dfpn_add(sum, or_node ? cdn[i] : cpn[i]);
+            if (sel < min1) { min2 = min1; min1 = sel; best = i; }
+            else if (sel < min2) min2 = sel;
+        }
+        pn = or_node ? min1 : sum;
+        dn = or_node ? sum : min1;
+        if (pn >= thpn || dn >= thdn || s->stop) break;
+
+        /* The best child is searched until it is no longer best (with
+           25% slack against thrashing) or the parent hits a threshold. */
+        unsigned int slack = dfpn_add(min2, min2 / 4 + 1);
+        if (slack <= min1) slack = min1 + 1;       /* both saturated */
+        unsigned int child_thpn, child_thdn;
+        if (or_node) {
+            child_thpn = thpn < slack ? thpn : slack;
+            child_thdn = thdn - dn + cdn[best];
+        } else {
+            child_thdn = thdn < slack ? thdn : slack;
+            child_thpn = thpn - pn + cpn[best];
+        }
+        Undo u;
+        make_move(g, &moves[best], &u);
+        s->path[ply + 1] = g->key;
+        work += dfpn_mid(s, g, ply + 1, child_thpn, child_thdn, &cpn[best], &cdn[best]);
+        unmake_move(g, &u);
+    }
+    dfpn_store(s->table, dfpn_key(s, g), pn, dn, work);
+    *pn_out = pn;
+    *dn_out = dn;
+    return work;
+}
+
+/* 1 if attacker wins from g, 0 if not, -1 if out of time. */
+static int dfpn_prove(DfpnSolver *s, GameState *g, int attacker) {
+    unsigned int pn, dn;
+    s->attacker = attacker;
+    s->path[0] = g->key;
+    if (!dfpn_leaf(s, g, 0, &pn, &dn)) dfpn_mid(s, g, 0, DFPN_INF, DFPN_INF, &pn, &dn);
+    if (pn == 0) return 1;
+    if (dn == 0) return 0;
+    return -1;
+}
+
+/* Positions already counted by dfpn_proof_size(): open addressing. */
+typedef struct {
+    unsigned long long *keys;
+    size_t cap, count;
+} DfpnSeen;
+
+static int dfpn_seen_add(DfpnSeen *v, unsigned long long key) {
+    if ((v->count + 1) * 2 > v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 1024;
+        unsigned long long *keys = calloc(cap, sizeof(*keys));
+        if (!keys) return 0;
+        for (size_t i = 0; i < v->cap; ++i) {
+            if (!v->keys[i]) continue;
+            size_t j = v->keys[i] & (cap - 1);
+            while (keys[j]) j = (j + 1) & (cap - 1);
+            keys[j] = v->keys[i];
+        }
+        free(v->keys);
+        v->keys = keys;
+        v->cap = cap;
+    }
+    size_t j = key & (v->cap - 1);
+    while (v->keys[j]) {
+        if (v->keys[j] == key) return 0;
+        j = (j + 1) & (v->cap - 1);
+    }
+    v->keys[j] = key;
+    v->count++;
+    return 1;
+}
+
+/* Walks the proof of s->attacker's win below g: one proven move at the
+   attacker's nodes, every move at the defender's.  Counts distinct
+   positions in seen; *missing gets nodes whose proof the GC dropped. */
+static void dfpn_proof_size(DfpnSolver *s, GameState *g, int ply, DfpnSeen *seen, unsigned long long *missing) {
+    if (!dfpn_seen_add(seen, dfpn_key(s, g))) return;
+    unsigned int pn, dn;
+    s->path[ply] = g->key;
+    if (dfpn_leaf(s, g, ply, &pn, &dn)) return;
+    Move moves[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    int or_node = (g->turn == s->attacker);
+    for (int i = 0; i < n; ++i) {
+        Undo u;
+        make_move(g, &moves[i], &u);
+        s->path[ply + 1] = g->key;
+        int proven = dfpn_leaf(s, g, ply + 1, &pn, &dn) && pn == 0;
+        if (!proven) {
+            const DfpnEntry *e = dfpn_lookup(s->table, dfpn_key(s, g));
+            proven = e && e->pn == 0;
+        }
+        if (proven) dfpn_proof_size(s, g, ply + 1, seen, missing);
+        else if (!or_node) (*missing)++;
+        unmake_move(g, &u);
+        if (proven && or_node) return;
+    }
+    if (or_node) (*missing)++;
+}
+
+/* The attacker's proven move at the root, for the report. */
+static int dfpn_winning_move(DfpnSolver *s, GameState *g, Move *out) {
+    Move moves[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    for (int i = 0; i < n; ++i) {
+        Undo u;
+        unsigned int pn, dn;
+        make_move(g, &moves[i], &u);
+        s->path[1] = g->key;
+        int proven = dfpn_leaf(s, g, 1, &pn, &dn) && pn == 0;
+        if (!proven) {
+            const DfpnEntry *e = dfpn_lookup(s->table, dfpn_key(s, g));
+            proven = e && e->pn == 0;
+        }
+        unmake_move(g, &u);
+        if (proven) { *out = moves[i]; return 1; }
+    }
+    return 0;
+}
+
+int solve_main(int argc, char **argv) {
+    size_t mb = 64;
+    int max_ply = 160;
+    int time_ms = 0;
+    const char *file = NULL;
+    int npos = 0;
+    GameState *positions = malloc(sizeof(GameState) * (size_t)(argc + 1));
+    if (!positions) return 1;
+    for (int i = 0; i < argc; ) {
+        int used = parse_tb_arg(argc - i, argv + i);
+        if (used < 0) { free(positions); return 1; }
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--mb") == 0 && i + 1 < argc) { mb = (size_t)atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--maxply") == 0 && i + 1 < argc) { max_ply = atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) { time_ms = atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) { file = argv[i + 1]; i += 2; continue; }
+        if (!parse_position(argv[i], &positions[npos])) {
+            printf("Bad position %s\n", argv[i]);
+            free(positions);
+            return 1;
+        }
+        npos++;
+        i++;
+    }
+    if (file) {
+        GameState *more = realloc(positions, sizeof(GameState) * (size_t)(npos + MATCH_MAX_OPENINGS));
+        if (!more) { free(positions); return 1; }
+        positions = more;
+        int n = load_openings(file, positions + npos, MATCH_MAX_OPENINGS);
+        if (n < 0) { printf("Could not read %s\n", file); free(positions); return 1; }
+        npos += n;
+    }
+    if (npos == 0) {
+        printf("usage: solve [--mb N] [--maxply N] [--time ms] [--tb file] [--file f] [position]...\n");
+        free(positions);
+        return 1;
+    }
+    if (max_ply < 1) max_ply = 1;
+    if (max_ply > DFPN_MAX_PLY) max_ply = DFPN_MAX_PLY;
+
+    DfpnTable table;
+    if (!dfpn_table_init(&table, mb)) { printf("Could not allocate %zu MB.\n", mb); free(positions); return 1; }
+    printf("%zu entries (%zu MB), horizon %d plies\n",
+           table.buckets * DFPN_BUCKET, table.buckets * DFPN_BUCKET * sizeof(DfpnEntry) >> 20, max_ply);
+
+    static DfpnSolver s;
+    int solved = 0;
+    unsigned long long total_nodes = 0ULL;
+    double start = now_seconds();
+    for (int p = 0; p < npos; ++p) {
+        GameState g = positions[p];
+        g.key = compute_key(&g);
+        char fen[POSITION_STR_LEN];
+        format_position(&g, fen);
+        dfpn_table_clear(&table);
+        memset(&s, 0, sizeof(s));
+        s.table = &table;
+        s.max_ply = max_ply;
+        double t0 = now_seconds();
+        s.deadline = time_ms > 0 ? t0 + time_ms / 1000.0 : 0.0;
+
+        int me = g.turn;
+        int winner = -1;
+        int r = dfpn_prove(&s, &g, me);
+        if (r == 1) winner = me;
+        else if (r == 0 && (r = dfpn_prove(&s, &g, 1 - me)) == 1) winner = 1 - me;
+        double secs = now_seconds() - t0;
+
+        const char *result;
+        if (winner == me) result = "win";
+        else if (winner >= 0) result = "loss";
+        else if (r == 0 && !s.horizon && !s.repetition) result = "draw";
+        else if (r == 0 && !s.horizon) result = "no win found";
+        else result = "unknown";
+        if (winner >= 0 || (r == 0 && !s.horizon && !s.repetition)) solved++;
+        total_nodes += s.nodes;
+
+        printf("%s\n  %s for %s to move", fen, result, me == 0 ? "red" : "black");
+        if (winner == me) {
+            Move m;
+            char buf[MOVE_STR_LEN];
+            if (dfpn_winning_move(&s, &g, &m)) {
+                move_to_string(&m, buf);
+                printf(", %s", buf);
+            }
+        }
+        if (r < 0) printf(" (out of time)");
+        else if (winner < 0 && s.horizon) printf(" (no forced win for either side inside %d plies)", max_ply);
+        else if (winner < 0 && s.repetition) printf(" (repetitions cut the search, so a draw is not proven)");
+        printf("\n");
+        if (winner >= 0) {
+            DfpnSeen seen = { NULL, 0, 0 };
+            unsigned long long missing = 0ULL;
+            s.attacker = winner;
+            dfpn_proof_size(&s, &g, 0, &seen, &missing);
+            printf("  proof tree %zu positions", seen.count);
+            if (missing) printf(" (%llu subtrees lost to GC)", missing);
+            printf("\n");
+            free(seen.keys);
+        }
+        printf("  %llu nodes  %.3f s  %.0f nodes/s  table %zu%% full  gc %llu runs, %llu entries freed\n",
+               s.nodes, secs, secs > 0 ? (double)s.nodes / secs : 0.0,
+               table.used * 100 / (table.buckets * DFPN_BUCKET), table.gc_runs, table.gc_freed);
+        fflush(stdout);
+    }
+    double secs = now_seconds() - start;
+    printf("solved %d of %d positions in %.3f s (%.2f positions/s, %.0f nodes/s)\n",
+           solved, npos, secs, secs > 0 ? npos / secs : 0.0, secs > 0 ? (double)total_nodes / secs : 0.0);
+    free(table.entries);
+    free(positions);
+    tb_close(active_tb);
+    return solved == npos ? 0 : 1;
+}
+
+/*
+
+   Batch analysis
+
+   ./bitboard_checkers batch [--threads N] [--depth N] [--nodes N] [--time ms] [--hash MB]
+                             [--multipv N] [--window N] [--tb file] [--nnue file] <file|->
+
+   Searches every position of a list (one position string or start-
+   position move list per line, as for match openings; blank lines and
+   '#' comments are skipped) and writes one JSON object per position
+   line, in input order, with "line" its 1-based line number in the
+   input.  A line that does not parse gets an "error" object instead.
+   Then a summary line gives the throughput in positions per hour,
+   counting only the positions that were searched.
+
+   The main thread reads the list and deals jobs round-robin onto one
+   queue per worker.  A worker takes the oldest job of its own queue;
+   when that is empty it steals the newest job of another queue.  Each
+   job owns a slot of a ring of --window slots, the reorder buffer: the
+   reader waits while the ring is full, and whichever worker completes
+   the oldest outstanding job writes out every finished job from there
+   on.  So at most --window positions and results are held at once, and
+   a slow position holds up the output but not the other workers.
+
+   Every worker allocates its hash table (--hash MB each) and result
+   buffers once and reuses them for all its jobs; entries from earlier
+   jobs age out through tt_new_search().  Each search is single-threaded.
+   Multi-PV line k is a search with lines 1..k-1's first moves left out
+   of the root, and --depth/--nodes/--time apply to each line.
+
+*/
+
+#define BATCH_MAX_THREADS 256
+#define BATCH_MAX_PV      16
+#define BATCH_LINE_LEN    4096
+
+typedef struct {
+    GameState g;
+    long index;                  /* job number, the output order */
+    long line;                   /* input line number */
+    int valid;                   /* 0: the input line did not parse */
+    int done;
+    char *out;                   /* the JSON line, BATCH_OUT_LEN(multipv) bytes */
+} BatchSlot;
+
+/* Queue of slot numbers; head is the oldest.  Capacity is the window. */
+typedef struct {
+    pthread_mutex_t lock;
+    int *items;
+    int head;
+    int count;
+} BatchQueue;
+
+typedef struct BatchPool BatchPool;
+
+typedef struct {
+    BatchPool *pool;
+    int id;
+    TransTable tt;
+    unsigned long long nodes;
+    long jobs;
+    long steals;
+    pthread_t thread;
+} BatchWorker;
+
+struct BatchPool {
+    SearchLimits limits;
+    int multipv;
+    int window;
+    int nthreads;
+    size_t out_len;
+    BatchSlot *slots;
+    BatchQueue *queues;
+    BatchWorker *workers;
+    pthread_mutex_t lock;        /* pending, closed, next_out, slot done flags, stdout */
+    pthread_cond_t work_cv;
+    pthread_cond_t slot_cv;
+    int pending;                 /* jobs sitting in queues */
+    int closed;                  /* the reader is done */
+    long next_out;               /* index of the next line to write */
+};
+
+#define BATCH_OUT_LEN(multipv) ((size_t)256 + (size_t)(multipv) * (96 + MAX_PLY * 12))
+
+static void batch_push(BatchQueue *q, int window, int slot) {
+    pthread_mutex_lock(&q->lock);
+    q->items[(q->head + q->count) % window] = slot;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* oldest = 1 takes from the head (owner), 0 from the tail (thief). */
+static int batch_take(BatchQueue *q, int window, int oldest, int *slot) {
+    int ok = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->count) {
+        if (oldest) { *slot = q->items[q->head]; q->head = (q->head + 1) % window; }
+        else *slot = q->items[(q->head + q->count - 1) % window];
+        q->count--;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static int batch_next_job(BatchWorker *w, int *slot) {
+    BatchPool *p = w->pool;
+    int got = batch_take(&p->queues[w->id], p->window, 1, slot);
+    for (int k = 1; !got && k < p->nthreads; ++k) {
+        got = batch_take(&p->queues[(w->id + k) % p->nthreads], p->window, 0, slot);
+        if (got) w->steals++;
+    }
+    if (got) {
+        pthread_mutex_lock(&p->lock);
+        p->pending--;
+        pthread_mutex_unlock(&p->lock);
+    }
+    return got;
+}
+
+/* Appends to a fixed buffer; output past the end is dropped. */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} BatchText;
+
+static void batch_put(BatchText *t, const char *fmt, ...) {
+    if (t->len + 1 >= t->cap) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(t->buf + t->len, t->cap - t->len, fmt, ap);
+    va_end(ap);
+    if (n > 0) t->len = (t->len + (size_t)n < t->cap) ? t->len + (size_t)n : t->cap - 1;
+}
+
+static void batch_analyse(BatchWorker *w, BatchSlot *slot) {
+    BatchPool *p = w->pool;
+    BatchText t = { slot->out, 0, p->out_len };
+    if (!slot->valid) {
+        batch_put(&t, "{\"type\":\"position\",\"line\":%ld,\"error\":\"bad position\"}\n", slot->line);
+        return;
+    }
+    char fen[POSITION_STR_LEN];
+    format_position(&slot->g, fen);
+    batch_put(&t, "{\"type\":\"position\",\"line\":%ld,\"position\":\"%s\",\"lines\":[", slot->line, fen);
+
+    Move excluded[BATCH_MAX_PV];
+    SearchLimits limits = p->limits;
+    limits.threads = 1;
+    limits.exclude = excluded;
+    limits.nexclude = 0;
+    unsigned long long nodes = 0ULL;
+    double t0 = now_seconds();
+    for (int k = 0; k < p->multipv; ++k) {
+        SearchResult r;
+        search_position(&slot->g, &limits, &w->tt, &r, 0);
+        nodes += r.nodes;
+        if (!r.has_move) break;
+        char buf[MOVE_STR_LEN];
+        move_to_string(&r.best, buf);
+        batch_put(&t, "%s{\"rank\":%d,\"move\":\"%s\",\"score\":%d,\"depth\":%d,\"pv\":\"",
+                  k ? "," : "", k + 1, buf, r.score, r.depth);
+        for (int i = 0; i < r.pv_len; ++i) {
+            move_to_string(&r.pv[i], buf);
+            batch_put(&t, "%s%s", i ? " " : "", buf);
+        }
+        batch_put(&t, "\"}");
+        excluded[limits.nexclude++] = r.best;
+    }
+    batch_put(&t, "],\"nodes\":%llu,\"time\":%.6f}\n", nodes, now_seconds() - t0);
+    w->nodes += nodes;
+}
+
+/* Marks a slot finished and writes out every finished line from
+   next_out on, freeing their slots for the reader. */
+static void batch_finish(BatchPool *p, BatchSlot *slot) {
+    pthread_mutex_lock(&p->lock);
+    slot->done = 1;
+    int wrote = 0;
+    for (BatchSlot *s = &p->slots[p->next_out % p->window]; s->done && s->index == p->next_out;
+         s = &p->slots[p->next_out % p->window]) {
+        fputs(s->out, stdout);
+        s->done = 0;
+        p->next_out++;
+        wrote = 1;
+    }
+    if (wrote) {
+        fflush(stdout);
+        pthread_cond_broadcast(&p->slot_cv);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *batch_worker(void *arg) {
+    BatchWorker *w = (BatchWorker *)arg;
+    BatchPool *p = w->pool;
+    for (;;) {
+        int slot;
+        if (batch_next_job(w, &slot)) {
+            batch_analyse(w, &p->slots[slot]);
+            batch_finish(p, &p->slots[slot]);
+            w->jobs++;
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        while (!p->pending && !p->closed) pthread_cond_wait(&p->work_cv, &p->lock);
+        int quit = !p->pending && p->closed;
+        pthread_mutex_unlock(&p->lock);
+        if (quit) break;
+    }
+    return NULL;
+}
+
+static int batch_pool_init(BatchPool *p) {
+    p->out_len = BATCH_OUT_LEN(p->multipv);
+    p->slots = calloc((size_t)p->window, sizeof(BatchSlot));
+    p->queues = calloc((size_t)p->nthreads, sizeof(BatchQueue));
+    p->workers = calloc((size_t)p->nthreads, sizeof(BatchWorker));
+    if (!p->slots || !p->queues || !p->workers) return 0;
+    for (int i = 0; i < p->window; ++i) {
+        p->slots[i].index = -1;
+        if (!(p->slots[i].out = malloc(p->out_len))) return 0;
+    }
+    for (int i = 0; i < p->nthreads; ++i) {
+        pthread_mutex_init(&p->queues[i].lock, NULL);
+        if (!(p->queues[i].items = malloc(sizeof(int) * (size_t)p->window))) return 0;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_cv, NULL);
+    pthread_cond_init(&p->slot_cv, NULL);
+    return 1;
+}
+
+static void batch_pool_free(BatchPool *p) {
+    for (int i = 0; p->slots && i < p->window; ++i) free(p->slots[i].out);
+    for (int i = 0; p->queues && i < p->nthreads; ++i) {
+        pthread_mutex_destroy(&p->queues[i].lock);
+        free(p->queues[i].items);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work_cv);
+    pthread_cond_destroy(&p->slot_cv);
+    free(p->slots);
+    free(p->queues);
+    free(p->workers);
+}
+
+int batch_main(int argc, char **argv) {
+    static BatchPool pool;
+    memset(&pool, 0, sizeof(pool));
+    BatchPool *p = &pool;
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    size_t hash_mb = TT_DEFAULT_MB;
+    int threads = 1, multipv = 1, window = 0;
+    const char *path = NULL;
+    for (int i = 0; i < argc; ) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { threads = atoi(argv[i + 1]); i += 2; continue; }
+        int used = parse_limit_arg(argc - i, argv + i, &limits);
+        if (used) { i += used; continue; }
+        used = parse_tb_arg(argc - i, argv + i);
+        if (used < 0) return 1;
+        if (used) { i += used; continue; }
+        used = parse_nnue_arg(argc - i, argv + i);
+        if (used < 0) return 1;
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) { hash_mb = (size_t)atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--multipv") == 0 && i + 1 < argc) { multipv = atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) { window = atoi(argv[i + 1]); i += 2; continue; }
+        path = argv[i++];
+    }
+    if (!path) {
+        printf("usage: batch [--threads N] [--depth N] [--nodes N] [--time ms] [--hash MB] "
+               "[--multipv N] [--window N] [--tb file] [--nnue file] <file|->\n");
+        return 1;
+    }
+    if (!limits.depth && !limits.nodes && !limits.movetime_ms) limits.depth = 10;
+    if (threads < 1) threads = 1;
+    if (threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+    if (multipv < 1) multipv = 1;
+    if (multipv > BATCH_MAX_PV) multipv = BATCH_MAX_PV;
+    if (window < threads) window = window > 0 ? threads : 16 * threads;
+
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!in) { printf("Could not read %s\n", path); return 1; }
+
+    p->limits = limits;
+    p->multipv = multipv;
+    p->window = window;
+    p->nthreads = threads;
+    if (!batch_pool_init(p)) {
+        printf("Out of memory.\n");
+        batch_pool_free(p);
+        if (in != stdin) fclose(in);
+        return 1;
+    }
+    int started = 0;
+    for (; started < threads; ++started) {
+        BatchWorker *w = &p->workers[started];
+        w->pool = p;
+        w->id = started;
+        if (!tt_init(&w->tt, hash_mb)) { printf("Could not allocate %zu MB hash.\n", hash_mb); break; }
+        if (pthread_create(&w->thread, NULL, batch_worker, w) != 0) { tt_free(&w->tt); break; }
+    }
+
+    double start = now_seconds();
+    long n = 0, bad = 0, lineno = 0;
+    char line[BATCH_LINE_LEN];
+    while (started == threads && fgets(line, sizeof(line), in)) {
+        GameState g;
+        lineno++;
+        int r = parse_opening_line(line, &g);
+        if (!strchr(line, '\n') && !feof(in)) {
+            int ch;
+            while ((ch = fgetc(in)) != EOF && ch != '\n') {}
+            r = 0;                   /* longer than BATCH_LINE_LEN */
+        }
+        if (r < 0) continue;
+        if (r == 0) bad++;
+        pthread_mutex_lock(&p->lock);
+        while (n - p->next_out >= p->window) pthread_cond_wait(&p->slot_cv, &p->lock);
+        pthread_mutex_unlock(&p->lock);
+        int s = (int)(n % p->window);
+        BatchSlot *slot = &p->slots[s];
+        slot->g = g;
+        slot->valid = r;
+        slot->index = n;
+        slot->line = lineno;
+        batch_push(&p->queues[n % threads], p->window, s);
+        pthread_mutex_lock(&p->lock);
+        p->pending++;
+        pthread_cond_signal(&p->work_cv);
+        pthread_mutex_unlock(&p->lock);
+        n++;
+    }
+    if (in != stdin) fclose(in);
+
+    pthread_mutex_lock(&p->lock);
+    p->closed = 1;
+    pthread_cond_broadcast(&p->work_cv);
+    pthread_mutex_unlock(&p->lock);
+    unsigned long long nodes = 0ULL;
+    long steals = 0;
+    for (int i = 0; i < started; ++i) {
+        pthread_join(p->workers[i].thread, NULL);
+        nodes += p->workers[i].nodes;
+        steals += p->workers[i].steals;
+        tt_free(&p->workers[i].tt);
+    }
+    double secs = now_seconds() - start;
+    int ok = (started == threads);
+    batch_pool_free(p);
+    if (!ok) return 1;
+
+    printf("{\"type\":\"summary\",\"positions\":%ld,\"errors\":%ld,\"threads\":%d,\"multipv\":%d,"
+           "\"nodes\":%llu,\"time\":%.3f,\"nps\":%.0f,\"positions_per_hour\":%.0f,\"steals\":%ld}\n",
+           n - bad, bad, threads, multipv, nodes, secs, secs > 0 ? (double)nodes / secs : 0.0,
+           secs > 0 ? 3600.0 * (double)(n - bad) / secs : 0.0, steals);
+    return bad ? 1 : 0;
+}
+
+/*
+
+   Game server
+
+   ./bitboard_checkers server [--port N | --unix path] [--shards N] [--games N]
+   ./bitboard_checkers loadgen [--port N | --unix path] [--games N] [--moves N]
+
+   One process hosts many games, one per connection.  Each shard thread
+   runs its own epoll loop over a fixed slice of a pool of connections
+   allocated up front, so a new game takes a free slot instead of
+   allocating.  Every shard watches the one listening socket
+   (EPOLLEXCLUSIVE wakes a single shard per connection).  One reply
+   line per request line:
+
+     new            -> "ok <fen>"   (a connection starts with a new game)
+     position       -> "ok <fen>"
+     <move>         -> "ok <fen>" | "over red|black <fen>" |
+                       "continue <square>" | "error <text>"
+     quit
+
+   A move is "b3 c4", "b3-c4" or a whole chain "b3xd5xf7".  Every step goes
+   through validate_simple_move() and execute_move(), as in play_game,
+   with the same must-capture and continue-jumping checks.  A chain that
+   stops while the piece can still jump gets "continue <square>", and the
+   rest (with or without the square) comes on the next line.  A man that
+   is crowned ends the move, as in the move generator.  A move that
+   fails anywhere leaves the game as it was.
+
+   Lines are parsed in place in the connection's read buffer.  Replies
+   are appended to its write buffer, and each batch of input gets one
+   write(), so a client that pipelines requests gets one send back.  A
+   client whose unread replies fill the buffer is dropped.
+
+*/
+
+#define SERVER_PORT      7777
+#define SERVER_IN_BUF    512
+#define SERVER_OUT_BUF   2048
+#define SERVER_EVENTS    256
+
+typedef struct ServerConn {
+    int fd;
+    int cont_from;               /* square a jump must continue from, -1 if none */
+    int want_out;                /* EPOLLOUT registered */
+    GameState g;
+    size_t in_len, out_len, out_sent;
+    struct ServerConn *next_free;
+    char in[SERVER_IN_BUF];
+    char out[SERVER_OUT_BUF];
+} ServerConn;
+
+typedef struct {
+    int listen_fd;
+    int epfd;
+    int is_tcp;
+    int listening;               /* listen_fd is in epfd */
+    ServerConn *free_list;
+    int active;
+    unsigned long long accepted, requests, moves;
+    pthread_t thread;
+} ServerShard;
+
+/* Set by the signal handler in whichever thread takes the signal and
+   read by every shard, so it is atomic; a lock-free atomic_int is safe
+   to store from a handler. */
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2, "server_stop must be lock-free");
+static atomic_int server_stop;
+
+static void server_signal(int sig) {
+    (void)sig;
+    atomic_store_explicit(&server_stop, 1, memory_order_relaxed);
+}
+
+/* Raises the open-file limit to the hard limit; returns the new soft limit. */
+static long raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return -1;
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return (long)rl.rlim_cur;
+}
+
+/* Parses --port/--unix; returns the number of argv entries used. */
+static int parse_endpoint_arg(int argc, char **argv, int *port, const char **unix_path) {
+    if (argc < 2) return 0;
+    if (strcmp(argv[0], "--port") == 0) { *port = atoi(argv[1]); return 2; }
+    if (strcmp(argv[0], "--unix") == 0) { *unix_path = argv[1]; return 2; }
+    return 0;
+}
+
+/* Fills addr for 127.0.0.1:port or a Unix socket path; returns its length, 0 if the path is too long. */
+static socklen_t endpoint_addr(struct sockaddr_storage *addr, int port, const char *unix_path) {
+    memset(addr, 0, sizeof(*addr));
+    if (unix_path) {
+        struct sockaddr_un *un = (struct sockaddr_un *)addr;
+        if (strlen(unix_path) >= sizeof(un->sun_path)) return 0;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, unix_path);
+        return (socklen_t)sizeof(*un);
+    }
+    struct sockaddr_in *in = (struct sockaddr_in *)addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((unsigned short)port);
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return (socklen_t)sizeof(*in);
+}
+
+static void server_reply(ServerConn *c, const char *fmt, ...) {
+    if (c->out_len >= SERVER_OUT_BUF) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(c->out + c->out_len, SERVER_OUT_BUF - c->out_len, fmt, ap);
+    va_end(ap);
+    /* a reply that does not fit marks the buffer full; the client is dropped */
+    c->out_len = (n < 0 || (size_t)n >= SERVER_OUT_BUF - c->out_len) ? SERVER_OUT_BUF : c->out_len + (size_t)n;
+}
+
+static void server_reply_position(ServerConn *c, const char *status) {
+    char fen[POSITION_STR_LEN];
+    format_position(&c->g, fen);
+    server_reply(c, "%s %s\n", status, fen);
+}
+
+/* Plays the move text in line (NUL-terminated, in the read buffer). */
+static void server_move(ServerShard *sh, ServerConn *c, const char *line) {
+    int squares[MAX_JUMPS + 2], n = 0;
+    if (c->cont_from >= 0) squares[n++] = c->cont_from;
+    for (const char *p = line; *p; ) {
+        if (isspace((unsigned char)*p) || *p == '-' || *p == 'x' || *p == 'X') { p++; continue; }
+        char coord[3] = { p[0], p[1], '\0' };
+        int sq = p[1] ? coord_to_index(coord) : -1;
+        if (sq < 0 || n > MAX_JUMPS) { server_reply(c, "error bad move text\n"); return; }
+        /* after "continue", the piece's own square may be repeated */
+        if (!(n == 1 && c->cont_from >= 0 && sq == c->cont_from)) squares[n++] = sq;
+        p += 2;
+    }
+    if (n < 2) { server_reply(c, "error bad move text\n"); return; }
+
+    GameState t = c->g;
+    int player = t.turn;
+    int cont = -1;
+    for (int k = 1; k < n; ++k) {
+        int from = squares[k - 1], to = squares[k];
+        int jumping = (k > 1 || c->cont_from >= 0);
+        unsigned long long own = (player == 0) ? all_red(&t) : all_black(&t);
+        if (!GetBit64(own, from)) { server_reply(c, "error no piece of yours there\n"); return; }
+        int is_cap = 0;
+        if (!validate_simple_move(&t, player, from, to, &is_cap)) { server_reply(c, "error illegal move\n"); return; }
+        if (jumping && !is_cap) { server_reply(c, "error must continue jumping\n"); return; }
+        if (!is_cap && player_has_capture(&t, player)) { server_reply(c, "error a capture is mandatory\n"); return; }
+        int was_man = GetBit64((player == 0) ? t.red_man : t.blk_man, from);
+        int r = execute_move(&t, player, from, to);
+        if (r == -1) { server_reply(c, "error illegal move\n"); return; }
+        int crowned = was_man && GetBit64((player == 0) ? t.red_king : t.blk_king, to);
+        cont = (r == 2 && !crowned) ? to : -1;
+        if (cont < 0 && k < n - 1) { server_reply(c, "error the move ended at %c%c\n", 'a' + SQ_COL(to), '1' + SQ_ROW(to)); return; }
+    }
+    c->g = t;
+    c->cont_from = cont;
+    if (cont >= 0) {
+        server_reply(c, "continue %c%c\n", 'a' + SQ_COL(cont), '1' + SQ_ROW(cont));
+        return;
+    }
+    c->g.turn = 1 - player;
+    sh->moves++;
+    int opp = c->g.turn;
+    int opp_pieces = (opp == 0) ? count_red(&c->g) : count_black(&c->g);
+    if (opp_pieces == 0 || !player_has_any_move(&c->g, opp))
+        server_reply_position(c, player == 0 ? "over red" : "over black");
+    else
+        server_reply_position(c, "ok");
+}
+
+/* One request line; returns 0 when the client asked to quit. */
+static int server_line(ServerShard *sh, ServerConn *c, char *line) {
+    sh->requests++;
+    const char *p = line;
+    size_t len;
+    const char *cmd = next_token(&p, &len);
+    if (!len) return 1;
+    if (token_is(cmd, len, "quit")) return 0;
+    if (token_is(cmd, len, "new")) {
+        init_game(&c->g);
+        c->cont_from = -1;
+        server_reply_position(c, "ok");
+    } else if (token_is(cmd, len, "position")) {
+        server_reply_position(c, "ok");
+    } else {
+        server_move(sh, c, line);
+    }
+    return 1;
+}
+
+/* A shard with no free slot stops watching the listening socket, so
+   new connections go to the other shards or wait in the backlog. */
+static void server_listen(ServerShard *sh, int on) {
+    if (on == sh->listening) return;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = NULL;
+    epoll_ctl(sh->epfd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, sh->listen_fd, &ev);
+    sh->listening = on;
+}
+
+static void server_close(ServerShard *sh, ServerConn *c) {
+    epoll_ctl(sh->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->next_free = sh->free_list;
+    sh->free_list = c;
+    sh->active--;
+    server_listen(sh, 1);
+}
+
+/* Sends what is buffered; returns 0 if the connection has to go. */
+static int server_flush(ServerShard *sh, ServerConn *c) {
+    if (c->out_len >= SERVER_OUT_BUF) return 0;
+    while (c->out_sent < c->out_len) {
+        ssize_t w = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && errno == EAGAIN) break;
+        if (w <= 0) return 0;
+        c->out_sent += (size_t)w;
+    }
+    int pending = c->out_sent < c->out_len;
+    if (!pending) c->out_len = c->out_sent = 0;
+    if (pending != c->want_out) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (pending ? EPOLLOUT : 0);
+        ev.data.ptr = c;
+        epoll_ctl(sh->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_out = pending;
+    }
+    return 1;
+}
+
+/* Reads what is there and answers every complete line; returns 0 on
+   EOF, error or quit. */
+static int server_read(ServerShard *sh, ServerConn *c) {
+    ssize_t r = read(c->fd, c->in + c->in_len, SERVER_IN_BUF - 1 - c->in_len);
+    if (r < 0 && (errno == EAGAIN || errno == EINTR)) return 1;
+    if (r <= 0) return 0;
+    c->in_len += (size_t)r;
+    char *p = c->in, *end = c->in + c->in_len;
+    char *nl;
+    int keep = 1;
+    while (keep && (nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        *nl = '\0';
+        if (nl > p && nl[-1] == '\r') nl[-1] = '\0';
+        keep = server_line(sh, c, p);
+        p = nl + 1;
+    }
+    c->in_len = (size_t)(end - p);
+    if (c->in_len == SERVER_IN_BUF - 1) {
+        server_reply(c, "error line too long\n");
+        c->in_len = 0;
+    } else if (c->in_len && p != c->in) {
+        memmove(c->in, p, c->in_len);
+    }
+    return server_flush(sh, c) && keep;
+}
+
+/* Takes a few connections per wakeup so that a burst is spread over the
+   shards instead of filling the first one to wake. */
+static void server_accept(ServerShard *sh) {
+    for (int i = 0; i < 16 && sh->free_list; ++i) {
+        int fd = accept4(sh->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;      /* EAGAIN, or another shard got it */
+        ServerConn *c = sh->free_list;
+        sh->free_list = c->next_free;
+        if (sh->is_tcp) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        c->fd = fd;
+        c->cont_from = -1;
+        c->want_out = 0;
+        c->in_len = c->out_len = c->out_sent = 0;
+        init_game(&c->g);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(sh->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            c->fd = -1;
+            c->next_free = sh->free_list;
+            sh->free_list = c;
+            continue;
+        }
+        sh->active++;
+        sh->accepted++;
+    }
+    if (!sh->free_list) server_listen(sh, 0);
+}
+
+static void *server_shard_main(void *arg) {
+    ServerShard *sh = (ServerShard *)arg;
+    struct epoll_event events[SERVER_EVENTS];
+    while (!atomic_load_explicit(&server_stop, memory_order_relaxed)) {
+        int n = epoll_wait(sh->epfd, events, SERVER_EVENTS, 200);
+        for (int i = 0; i < n; ++i) {
+            ServerConn *c = (ServerConn *)events[i].data.ptr;
+            if (!c) { server_accept(sh); continue; }
+            unsigned int e = events[i].events;
+            int ok = !(e & EPOLLERR);
+            if (ok && (e & (EPOLLIN | EPOLLHUP))) ok = server_read(sh, c);
+            if (ok && (e & EPOLLOUT)) ok = server_flush(sh, c);
+            if (!ok) server_close(sh, c);
+        }
+    }
+    return NULL;
+}
+
+int server_main(int argc, char **argv) {
+    int port = SERVER_PORT, shards = 1, games = 16384;
+    const char *unix_path = NULL;
+    for (int i = 0; i < argc; ) {
+        int used = parse_endpoint_arg(argc - i, argv + i, &port, &unix_path);
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) { shards = atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--games") == 0 && i + 1 < argc) { games = atoi(argv[i + 1]); i += 2; continue; }
+        printf("usage: server [--port N | --unix path] [--shards N] [--games N]\n");
+        return 1;
+    }
+    if (shards < 1) shards = 1;
+    if (games < shards) games = shards;
+    long fds = raise_fd_limit();
+    if (fds >= 0 && fds < games + 64) printf("warning: open-file limit %ld is below --games %d\n", fds, games);
+
+    struct sockaddr_storage addr;
+    socklen_t alen = endpoint_addr(&addr, port, unix_path);
+    int lfd = alen ? socket(unix_path ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) : -1;
+    if (lfd < 0) { printf("Could not create the socket\n"); return 1; }
+    int one = 1;
+    if (!unix_path) setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    else unlink(unix_path);
+    if (bind(lfd, (struct sockaddr *)&addr, alen) != 0 || listen(lfd, 4096) != 0) {
+        printf("Could not listen on %s: %s\n", unix_path ? unix_path : "127.0.0.1", strerror(errno));
+        close(lfd);
+        return 1;
+    }
+
+    ServerConn *pool = calloc((size_t)games, sizeof(ServerConn));
+    ServerShard *sh = calloc((size_t)shards, sizeof(ServerShard));
+    if (!pool || !sh) { printf("out of memory\n"); return 1; }
+    for (int s = 0; s < shards; ++s) {
+        sh[s].listen_fd = lfd;
+        sh[s].is_tcp = !unix_path;
+        sh[s].epfd = epoll_create1(EPOLL_CLOEXEC);
+        /* every shard takes the slots i with i % shards == s */
+        for (int i = games - 1 - (games - 1 - s) % shards; i >= 0; i -= shards) {
+            pool[i].fd = -1;
+            pool[i].next_free = sh[s].free_list;
+            sh[s].free_list = &pool[i];
+        }
+        server_listen(&sh[s], 1);
+    }
+    signal(SIGINT, server_signal);
+    signal(SIGTERM, server_signal);
+    signal(SIGPIPE, SIG_IGN);
+    if (unix_path) printf("listening on %s", unix_path);
+    else printf("listening on 127.0.0.1:%d", port);
+    printf(", %d shard(s), %d game slots (%zu KB)\n", shards, games, (size_t)games * sizeof(ServerConn) >> 10);
+    fflush(stdout);
+
+    for (int s = 1; s < shards; ++s) pthread_create(&sh[s].thread, NULL, server_shard_main, &sh[s]);
+    server_shard_main(&sh[0]);
+    unsigned long long accepted = 0, requests = 0, moves = 0;
+    for (int s = 0; s < shards; ++s) {
+        if (s) pthread_join(sh[s].thread, NULL);
+        accepted += sh[s].accepted;
+        requests += sh[s].requests;
+        moves += sh[s].moves;
+        close(sh[s].epfd);
+    }
+    for (int i = 0; i < games; ++i) if (pool[i].fd >= 0) close(pool[i].fd);
+    close(lfd);
+    if (unix_path) unlink(unix_path);
+    printf("%llu connection(s), %llu request(s), %llu move(s)\n", accepted, requests, moves);
+    free(pool);
+    free(sh);
+    return 0;
+}
+
+/* Load generator: --games connections each play random legal moves,
+   one request in flight per game, and check every position the server
+   sends back against their own copy of the game. */
+typedef struct {
+    int fd;
+    int ply;
+    GameState g;
+    char expect[POSITION_STR_LEN];   /* "" after new */
+    double sent_at;
+    int is_move;
+    size_t in_len;
+    char in[256];
+} LoadConn;
+
+/* Sends the game's next request: a random legal move, or new. */
+static int loadgen_send(LoadConn *c, unsigned long long *seed) {
+    Move moves[MAX_MOVES];
+    int n = c->ply < 200 ? generate_moves(&c->g, c->g.turn, moves) : 0;
+    char line[MOVE_STR_LEN + 8];
+    if (n == 0) {
+        init_game(&c->g);
+        c->ply = 0;
+        c->expect[0] = '\0';
+        c->is_move = 0;
+        strcpy(line, "new\n");
+    } else {
+        const Move *m = &moves[splitmix64(seed) % (unsigned long long)n];
+        move_to_string(m, line);
+        strcat(line, "\n");
+        apply_move(&c->g, m);
+        c->ply++;
+        format_position(&c->g, c->expect);
+        c->is_move = 1;
+    }
+    c->sent_at = now_seconds();
+    size_t len = strlen(line);
+    return write(c->fd, line, len) == (ssize_t)len;
+}
+
+int loadgen_main(int argc, char **argv) {
+    int port = SERVER_PORT, games = 10000;
+    long total_moves = 200000;
+    const char *unix_path = NULL;
+    for (int i = 0; i < argc; ) {
+        int used = parse_endpoint_arg(argc - i, argv + i, &port, &unix_path);
+        if (used) { i += used; continue; }
+        if (strcmp(argv[i], "--games") == 0 && i + 1 < argc) { games = atoi(argv[i + 1]); i += 2; continue; }
+        if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc) { total_moves = atol(argv[i + 1]); i += 2; continue; }
+        printf("usage: loadgen [--port N | --unix path] [--games N] [--moves N]\n");
+        return 1;
+    }
+    if (games < 1) games = 1;
+    if (total_moves < 1) total_moves = 1;
+    long fds = raise_fd_limit();
+    if (fds >= 0 && fds < games + 16) { printf("open-file limit %ld is too low for %d games\n", fds, games); return 1; }
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_storage addr;
+    socklen_t alen = endpoint_addr(&addr, port, unix_path);
+    LoadConn *conns = calloc((size_t)games, sizeof(LoadConn));
+    double *lat = malloc((size_t)total_moves * sizeof(double));
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (!alen || !conns || !lat || epfd < 0) { printf("setup failed\n"); return 1; }
+
+    double t0 = now_seconds();
+    for (int i = 0; i < games; ++i) {
+        LoadConn *c = &conns[i];
+        c->fd = socket(unix_path ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, alen) != 0) {
+            printf("connect %d failed: %s\n", i, strerror(errno));
+            return 1;
+        }
+        if (!unix_path) {
+            int one = 1;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+        init_game(&c->g);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    }
+    double connect_s = now_seconds() - t0;
+    printf("%d connections in %.2f s\n", games, connect_s);
+    fflush(stdout);
+
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    long sent = 0, done = 0, mismatches = 0, errors = 0;
+    int in_flight = 0;
+    t0 = now_seconds();
+    for (int i = 0; i < games; ++i) {
+        conns[i].ply = 200;      /* first request is new */
+        if (!loadgen_send(&conns[i], &seed)) { printf("send failed\n"); return 1; }
+        in_flight++;
+    }
+    struct epoll_event events[SERVER_EVENTS];
+    while (in_flight > 0) {
+        int n = epoll_wait(epfd, events, SERVER_EVENTS, 5000);
+        if (n == 0) { printf("timed out with %d request(s) in flight\n", in_flight); break; }
+        for (int e = 0; e < n; ++e) {
+            LoadConn *c = (LoadConn *)events[e].data.ptr;
+            ssize_t r = read(c->fd, c->in + c->in_len, sizeof(c->in) - 1 - c->in_len);
+            if (r <= 0) {
+                if (r < 0 && errno == EAGAIN) continue;
+                printf("server closed a connection\n");
+                return 1;
+            }
+            c->in_len += (size_t)r;
+            char *nl = memchr(c->in, '\n', c->in_len);
+            if (!nl) continue;
+            double now = now_seconds();
+            *nl = '\0';
+            /* "ok <fen>" or "over <side> <fen>": the fen is the last token */
+            const char *fen = strrchr(c->in, ' ');
+            int ok = (strncmp(c->in, "ok ", 3) == 0 || strncmp(c->in, "over ", 5) == 0) && fen;
+            if (!ok) errors++;
+            else if (c->is_move && strcmp(fen + 1, c->expect) != 0) mismatches++;
+            if (c->is_move) lat[done++] = now - c->sent_at;
+            size_t rest = c->in_len - (size_t)(nl + 1 - c->in);
+            memmove(c->in, nl + 1, rest);
+            c->in_len = rest;
+            in_flight--;
+            if (c->is_move) sent++;
+            if (sent + in_flight < total_moves) {
+                if (!loadgen_send(c, &seed)) { printf("send failed\n"); return 1; }
+                in_flight++;
+            }
+        }
+    }
+    double secs = now_seconds() - t0;
+    for (int i = 0; i < games; ++i) close(conns[i].fd);
+    close(epfd);
+
+    qsort(lat, (size_t)done, sizeof(double), cmp_double);
+#define LAT_PCT(p) (done ? lat[(size_t)((double)(done - 1) * (p))] * 1e6 : 0.0)
+    printf("%ld moves over %d games in %.2f s: %.0f moves/s\n", done, games, secs, secs > 0 ? done / secs : 0.0);
+    printf("round trip us: p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %.0f\n",
+           LAT_PCT(0.50), LAT_PCT(0.90), LAT_PCT(0.99), LAT_PCT(0.999), LAT_PCT(1.0));
+#undef LAT_PCT
+    printf("%ld position mismatch(es), %ld error repl%s\n", mismatches, errors, errors == 1 ? "y" : "ies");
+    free(conns);
+    free(lat);
+    return (mismatches || errors) ? 1 : 0;
+}
+
+/*
+
+   Pondering
+
+   With play --ponder the engine keeps searching on a background thread
+   while the human types.  It searches the position after the reply it
+   expects (the second move of its principal variation) or, when it has
+   none, the human's own position, which puts every reply in the hash
+   table.  The search starts with the ponder flag set, so it has no
+   budget.  When the human's move matches the expected reply, the flag is
+   cleared and the same search continues with the normal limits. On a
+   miss, the stop flag ends it at once and the real search starts on a
+   warm hash table.
+
+*/
+
+typedef struct {
+    GameState pos;               /* position being searched */
+    int expected;                /* 1: pos is after the expected reply; 0: all replies */
+    SearchLimits limits;
+    TransTable *tt;
+    atomic_int stop;
+    atomic_int ponder;
+    SearchResult result;
+    pthread_t thread;
+    int running;
+} Ponder;
+
+static void *ponder_thread_main(void *arg) {
+    Ponder *p = (Ponder *)arg;
+    search_position(&p->pos, &p->limits, p->tt, &p->result, 0);
+    return NULL;
+}
+
+static int same_position(const GameState *a, const GameState *b) {
+    return a->red_man == b->red_man && a->red_king == b->red_king &&
+           a->blk_man == b->blk_man && a->blk_king == b->blk_king && a->turn == b->turn;
+}
+
+/* g: the position after the engine's move; last: the search that chose it. */
+static void ponder_start(Ponder *p, const GameState *g, const SearchResult *last,
+                         const SearchLimits *limits, TransTable *tt) {
+    p->pos = *g;
+    p->expected = last->pv_len >= 2;
+    if (p->expected) apply_move(&p->pos, &last->pv[1]);
+    else if (!tt) return;        /* searching all replies only pays through the table */
+    p->limits = *limits;
+    p->limits.stop_flag = &p->stop;
+    p->limits.ponder = &p->ponder;
+    p->tt = tt;
+    atomic_store(&p->stop, 0);
+    atomic_store(&p->ponder, 1);
+    p->running = pthread_create(&p->thread, NULL, ponder_thread_main, p) == 0;
+}
+
+static void ponder_stop(Ponder *p) {
+    if (!p->running) return;
+    atomic_store(&p->stop, 1);
+    pthread_join(p->thread, NULL);
+    p->running = 0;
+}
+
+/* The human has moved to g.  On a ponder hit the running search becomes
+   the engine's search: waits for it, copies its result to *out and
+   returns 1.  Otherwise stops it and returns 0. */
+static int ponder_finish(Ponder *p, const GameState *g, SearchResult *out) {
+    if (!p->running) return 0;
+    if (!p->expected || !same_position(&p->pos, g)) { ponder_stop(p); return 0; }
+    atomic_store(&p->ponder, 0);
+    pthread_join(p->thread, NULL);
+    p->running = 0;
+    *out = p->result;
+    return 1;
+}
+
+/* engine_side: -1 = two humans, 0/1 = the engine plays red/black.
+   ponder: search during the human's turn (see Pondering above). */
+void play_game(int engine_side, const SearchLimits *limits, TransTable *tt, int ponder) {
+    Ponder pd;
+    memset(&pd, 0, sizeof(pd));
+    GameState g;
+    init_game(&g);
+    printf("Welcome to BitBoard Checkers (text-mode)!\n");
+    printf("Coordinate system: a-h left->right, 1-8 top->bottom. Example: b3 c4\n");
+    printf("Red pieces (r) start at top (rows 1..3) and move DOWN; Black (b) start bottom and move UP.\n");
+    printf("Kings are R/B. Play alternates turns. Captures are mandatory.\n\n");
+
+    while (1) {
+        print_board(&g);
+        int red_count = count_red(&g), black_count = count_black(&g);
+        if (red_count == 0) { printf("Black wins! (red has no pieces)\n"); break; }
+        if (black_count == 0) { printf("Red wins! (black has no pieces)\n"); break; }
+        int player = g.turn;
+        if (!player_has_any_move(&g, player)) {
+            if (player == 0) printf("Red has no legal moves. Black wins!\n");
+            else printf("Black has no legal moves. Red wins!\n");
             break;
         }
+        if (player == engine_side) {
+            SearchResult r;
+            char buf[MOVE_STR_LEN];
+            int hit = ponder_finish(&pd, &g, &r);
+            if (!hit) search_position(&g, limits, tt, &r, 0);
+            move_to_string(&r.best, buf);
+            printf("%s plays %s (depth %d, score %d%s)\n", (player==0) ? "Red" : "Black", buf, r.depth, r.score,
+                   hit ? ", ponder hit" : "");
+            apply_move(&g, &r.best);
+            if (ponder) ponder_start(&pd, &g, &r, limits, tt);
+            continue;
+        }
         printf("%s's turn. Enter move (e.g. b3 c4): ", (player==0) ? "Red" : "Black");
         char line[256];
         if (!fgets(line, sizeof(line), stdin)) {
@@ -482,7 +7078,7 @@ void play_game() {
             while (1) {
                 print_board(&g);
                 printf("Continue jump from %s to (enter destination): ", coord);
-                if (!fgets(nextline, sizeof(nextline), stdin)) { printf("Input error; quitting.\n"); return; }
+                if (!fgets(nextline, sizeof(nextline), stdin)) { printf("Input error; quitting.\n"); ponder_stop(&pd); return; }
                 if (!parse_move_input(nextline, &from_idx, &to_idx)) {
                     char trimmed[32]; int k=0;
                     for (char *q = nextline; *q && isspace((unsigned char)*q); q++);
@@ -528,6 +7124,510 @@ void play_game() {
             g.turn = 1 - g.turn;
         }
     }
+    ponder_stop(&pd);
+}
+
+/*
+
+   International draughts
+
+   The 10x10 game on its own 128-bit boards: bit idx = row*10 + col as
+   in the 8x8 engine, with the 50 dark squares numbered 1..50 from the
+   top-left (square n is on row (n-1)/5).  Black starts on 1-20 and
+   moves down, white starts on 31-50, moves up and plays first.
+
+   Rules that differ from checkers:
+     - men move forward but capture in all four directions;
+     - kings fly: they move any distance and take a piece from any
+       distance, landing on any empty square beyond it;
+     - captured pieces stay on the board until the move is over, so a
+       piece is taken only once and a taken piece blocks the way;
+     - the capture that takes the most pieces is mandatory;
+     - a man is only crowned when its move ends on the far row.
+   Capture sequences with the same origin, destination and captured set
+   are one move.
+
+   Nothing here is shared with the 8x8 code at run time.  The masks are
+   the GEOM_* macros on Board100 and the square table is expanded by the
+   preprocessor, so both are compile-time constants; a diagonal step is
+   a shift by 9 or 11.  The boards need unsigned __int128 (GCC/Clang on
+   64-bit targets); without it the draughts command only says so.  Only
+   move generation is implemented: there is no draughts search or play.
+
+   ./bitboard_checkers draughts perft <depth> [position] [--divide]
+   ./bitboard_checkers draughts check [max_depth]
+
+*/
+
+#ifdef __SIZEOF_INT128__
+
+typedef unsigned __int128 Board100;
+
+#define D_SIZE       10
+#define D_SQUARES    50
+#define D_DARK       GEOM_DARK(Board100, D_SIZE)
+#define D_FILE_A     GEOM_FILE(Board100, D_SIZE, 0)
+#define D_FILE_J     GEOM_FILE(Board100, D_SIZE, D_SIZE - 1)
+#define D_ROW_1      GEOM_ROW(Board100, D_SIZE, 0)            /* white crowns here */
+#define D_ROW_10     GEOM_ROW(Board100, D_SIZE, D_SIZE - 1)   /* black crowns here */
+
+_Static_assert((unsigned long long)D_DARK == 0xA556AA556AA556AAULL &&
+               (unsigned long long)(D_DARK >> 64) == 0x556AA556AULL, "10x10 dark squares");
+
+#define D_MAX_MOVES  256
+
+/* Square number - 1 -> bit index, one row of five per D_SQ_ROW. */
+#define D_SQ(k)      ((k) / 5 * D_SIZE + (k) % 5 * 2 + 1 - (k) / 5 % 2)
+#define D_SQ_ROW(k)  D_SQ(k), D_SQ(k + 1), D_SQ(k + 2), D_SQ(k + 3), D_SQ(k + 4)
+static const unsigned char D_SQ_TO_INDEX[D_SQUARES] = {
+    D_SQ_ROW(0),  D_SQ_ROW(5),  D_SQ_ROW(10), D_SQ_ROW(15), D_SQ_ROW(20),
+    D_SQ_ROW(25), D_SQ_ROW(30), D_SQ_ROW(35), D_SQ_ROW(40), D_SQ_ROW(45)
+};
+
+typedef struct {
+    Board100 white_man;
+    Board100 white_king;
+    Board100 black_man;
+    Board100 black_king;
+    int turn;                      /* 0 = white, 1 = black */
+} Draughts;
+
+typedef struct {
+    Board100 from;
+    Board100 to;                   /* equal to from when a king comes back */
+    Board100 captured;             /* every opponent piece taken */
+    unsigned char from_idx;
+    unsigned char to_idx;
+    unsigned char promote;
+    unsigned char ncaps;
+} DMove;
+
+static inline Board100 d_bit(int idx) {
+    return (Board100)1 << idx;
+}
+
+static inline int d_lowest(Board100 b) {
+    unsigned long long lo = (unsigned long long)b;
+    return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((unsigned long long)(b >> 64));
+}
+
+/* Same directions as shift_dir(): DR +11, DL +9, UR -9, UL -11. */
+static inline Board100 d_shift(Board100 b, int dir) {
+    switch (dir) {
+    case DIR_DR: return (b & ~D_FILE_J) << (D_SIZE + 1);
+    case DIR_DL: return (b & ~D_FILE_A) << (D_SIZE - 1);
+    case DIR_UR: return (b & ~D_FILE_J) >> (D_SIZE - 1);
+    default:     return (b & ~D_FILE_A) >> (D_SIZE + 1);
+    }
+}
+
+/* 1-based square number of a bit index (dark squares only). */
+static inline int d_square_number(int idx) {
+    return idx / D_SIZE * 5 + idx % D_SIZE / 2 + 1;
+}
+
+void draughts_init(Draughts *d) {
+    memset(d, 0, sizeof(*d));
+    for (int k = 0; k < 20; ++k) d->black_man |= d_bit(D_SQ_TO_INDEX[k]);
+    for (int k = 30; k < D_SQUARES; ++k) d->white_man |= d_bit(D_SQ_TO_INDEX[k]);
+}
+
+static inline Board100 d_all(const Draughts *d) {
+    return d->white_man | d->white_king | d->black_man | d->black_king;
+}
+
+typedef struct {
+    DMove *moves;
+    int count;
+    int best;                      /* most pieces taken by a listed move */
+    int is_king;
+    Board100 empty;                /* empty squares, moving piece lifted */
+    Board100 opp;
+    Board100 crown;
+} DCapCtx;
+
+/* A finished sequence: keep it if it takes at least as many pieces as
+   the best so far (dropping the shorter ones) and is not a duplicate. */
+static void d_add_capture(DCapCtx *ctx, const DMove *cur, Board100 at) {
+    if (cur->ncaps < ctx->best) return;
+    if (cur->ncaps > ctx->best) { ctx->best = cur->ncaps; ctx->count = 0; }
+    for (int i = 0; i < ctx->count; ++i)
+        if (ctx->moves[i].from == cur->from && ctx->moves[i].to == at &&
+            ctx->moves[i].captured == cur->captured) return;
+    if (ctx->count >= D_MAX_MOVES) return;
+    DMove *m = &ctx->moves[ctx->count++];
+    *m = *cur;
+    m->to = at;
+    m->to_idx = (unsigned char)d_lowest(at);
+    m->promote = !ctx->is_king && (at & ctx->crown) != 0;
+}
+
+static void d_capture_chain(DCapCtx *ctx, DMove *cur, Board100 at) {
+    int extended = 0;
+    Board100 takeable = ctx->opp & ~cur->captured;
+    for (int dir = 0; dir < 4; ++dir) {
+        Board100 victim = d_shift(at, dir);
+        if (ctx->is_king)
+            while (victim & ctx->empty) victim = d_shift(victim, dir);
+        victim &= takeable;
+        if (!victim) continue;
+        Board100 land = d_shift(victim, dir) & ctx->empty;
+        while (land) {
+            extended = 1;
+            cur->captured |= victim;
+            cur->ncaps++;
+            d_capture_chain(ctx, cur, land);
+            cur->captured &= ~victim;
+            cur->ncaps--;
+            if (!ctx->is_king) break;
+            land = d_shift(land, dir) & ctx->empty;
+        }
+    }
+    if (!extended && cur->ncaps) d_add_capture(ctx, cur, at);
+}
+
+/* Men of the side to move with an adjacent piece to take, set-wise. */
+static Board100 d_man_jumpers(const Draughts *d) {
+    Board100 men = d->turn ? d->black_man : d->white_man;
+    Board100 opp = d->turn ? (d->white_man | d->white_king) : (d->black_man | d->black_king);
+    Board100 empty = ~d_all(d) & D_DARK;
+    Board100 j = 0;
+    for (int dir = 0; dir < 4; ++dir)
+        j |= d_shift(d_shift(empty, dir ^ 3) & opp, dir ^ 3) & men;
+    return j;
+}
+
+/* Legal moves of the side to move; returns how many were written. */
+int draughts_moves(const Draughts *d, DMove *moves) {
+    Board100 men = d->turn ? d->black_man : d->white_man;
+    Board100 kings = d->turn ? d->black_king : d->white_king;
+    Board100 empty = ~d_all(d) & D_DARK;
+
+    DCapCtx ctx;
+    ctx.moves = moves;
+    ctx.count = 0;
+    ctx.best = 1;
+    ctx.opp = d->turn ? (d->white_man | d->white_king) : (d->black_man | d->black_king);
+    ctx.crown = d->turn ? D_ROW_10 : D_ROW_1;
+    Board100 capturers = d_man_jumpers(d) | kings;
+    while (capturers) {
+        Board100 from = capturers & (0 - capturers);
+        capturers &= capturers - 1;
+        DMove cur;
+        memset(&cur, 0, sizeof(cur));
+        cur.from = from;
+        cur.from_idx = (unsigned char)d_lowest(from);
+        ctx.is_king = (kings & from) != 0;
+        ctx.empty = empty | from;
+        d_capture_chain(&ctx, &cur, from);
+    }
+    if (ctx.count) return ctx.count;
+
+    int n = 0;
+    int fwd = d->turn ? DIR_DR : DIR_UR;
+    for (int dir = fwd; dir < fwd + 2; ++dir) {
+        Board100 targets = d_shift(men, dir) & empty;
+        while (targets && n < D_MAX_MOVES) {
+            Board100 to = targets & (0 - targets);
+            targets &= targets - 1;
+            DMove *m = &moves[n++];
+            memset(m, 0, sizeof(*m));
+            m->from = d_shift(to, dir ^ 3);
+            m->to = to;
+            m->from_idx = (unsigned char)d_lowest(m->from);
+            m->to_idx = (unsigned char)d_lowest(to);
+            m->promote = (to & ctx.crown) != 0;
+        }
+    }
+    /* King slides: one ray fill per direction moves every king at once;
+       each step's targets are matched to their king by walking back. */
+    for (int dir = 0; dir < 4; ++dir) {
+        Board100 ray = d_shift(kings, dir) & empty;
+        for (int dist = 1; ray; ++dist) {
+            Board100 targets = ray;
+            while (targets && n < D_MAX_MOVES) {
+                Board100 to = targets & (0 - targets);
+                targets &= targets - 1;
+                Board100 from = to;
+                for (int s = 0; s < dist; ++s) from = d_shift(from, dir ^ 3);
+                DMove *m = &moves[n++];
+                memset(m, 0, sizeof(*m));
+                m->from = from;
+                m->to = to;
+                m->from_idx = (unsigned char)d_lowest(from);
+                m->to_idx = (unsigned char)d_lowest(to);
+            }
+            ray = d_shift(ray, dir) & empty;
+        }
+    }
+    return n;
+}
+
+/* Plays a move from draughts_moves() and passes the turn. */
+void draughts_apply(Draughts *d, const DMove *m) {
+    Board100 *man = d->turn ? &d->black_man : &d->white_man;
+    Board100 *king = d->turn ? &d->black_king : &d->white_king;
+    Board100 *opp_man = d->turn ? &d->white_man : &d->black_man;
+    Board100 *opp_king = d->turn ? &d->white_king : &d->black_king;
+    if (*king & m->from) {
+        *king = (*king & ~m->from) | m->to;
+    } else {
+        *man &= ~m->from;
+        if (m->promote) *king |= m->to;
+        else *man |= m->to;
+    }
+    *opp_man &= ~m->captured;
+    *opp_king &= ~m->captured;
+    d->turn = 1 - d->turn;
+}
+
+/* "32-28" for a move, "28x17" (origin and destination) for a capture. */
+void draughts_move_string(const DMove *m, char *out) {
+    sprintf(out, "%d%c%d", d_square_number(m->from_idx), m->ncaps ? 'x' : '-',
+            d_square_number(m->to_idx));
+}
+
+/* FEN as for checkers but on squares 1..50: "W:W31-50:B1-20", with K
+   before a king's square; the leading letter is the side to move.
+   "startpos" is the initial position.  Returns 1 on success. */
+int draughts_parse(const char *s, Draughts *d) {
+    if (!s || !d) return 0;
+    while (isspace((unsigned char)*s)) s++;
+    if (strncmp(s, "startpos", 8) == 0) { draughts_init(d); return 1; }
+
+    memset(d, 0, sizeof(*d));
+    char side = (char)toupper((unsigned char)*s++);
+    if (side != 'W' && side != 'B') return 0;
+    d->turn = (side == 'W') ? 0 : 1;
+    while (*s == ':') {
+        s++;
+        char colour = (char)toupper((unsigned char)*s++);
+        if (colour != 'W' && colour != 'B') return 0;
+        while (*s && *s != ':' && !isspace((unsigned char)*s) && *s != '.') {
+            int king = 0;
+            if (*s == ',') { s++; continue; }
+            if (toupper((unsigned char)*s) == 'K') { king = 1; s++; }
+            if (!isdigit((unsigned char)*s)) return 0;
+            int lo = (int)strtol(s, (char **)&s, 10), hi = lo;
+            if (*s == '-') { s++; hi = (int)strtol(s, (char **)&s, 10); }
+            if (lo < 1 || hi < lo || hi > D_SQUARES) return 0;
+            for (int n = lo; n <= hi; ++n) {
+                Board100 bit = d_bit(D_SQ_TO_INDEX[n - 1]);
+                if (colour == 'W') { if (king) d->white_king |= bit; else d->white_man |= bit; }
+                else { if (king) d->black_king |= bit; else d->black_man |= bit; }
+            }
+        }
+    }
+    return 1;
+}
+
+/* Known counts from the initial position, index = depth. */
+static const unsigned long long DRAUGHTS_PERFT_REFERENCE[] = {
+    1ULL, 9ULL, 81ULL, 658ULL, 4265ULL, 27117ULL, 167140ULL, 1049442ULL,
+    6483961ULL, 41022423ULL, 258895763ULL
+};
+#define DRAUGHTS_PERFT_REFERENCE_DEPTH \
+    ((int)(sizeof(DRAUGHTS_PERFT_REFERENCE) / sizeof(DRAUGHTS_PERFT_REFERENCE[0])) - 1)
+
+unsigned long long draughts_perft(const Draughts *d, int depth) {
+    if (depth == 0) return 1ULL;
+    DMove moves[D_MAX_MOVES];
+    int n = draughts_moves(d, moves);
+    if (depth == 1) return (unsigned long long)n;
+    unsigned long long nodes = 0ULL;
+    for (int i = 0; i < n; ++i) {
+        Draughts next = *d;
+        draughts_apply(&next, &moves[i]);
+        nodes += draughts_perft(&next, depth - 1);
+    }
+    return nodes;
+}
+
+static int draughts_check(int max_depth) {
+    if (max_depth > DRAUGHTS_PERFT_REFERENCE_DEPTH) max_depth = DRAUGHTS_PERFT_REFERENCE_DEPTH;
+    int failures = 0;
+    Draughts d;
+    draughts_init(&d);
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        double t0 = now_seconds();
+        unsigned long long nodes = draughts_perft(&d, depth);
+        double secs = now_seconds() - t0;
+        int ok = (nodes == DRAUGHTS_PERFT_REFERENCE[depth]);
+        if (!ok) failures++;
+        printf("depth %2d  nodes %12llu  expected %12llu  %s  %8.3f s  %12.0f nps\n",
+               depth, nodes, DRAUGHTS_PERFT_REFERENCE[depth], ok ? "ok  " : "FAIL",
+               secs, secs > 0 ? (double)nodes / secs : 0.0);
+    }
+    printf("%d failure(s)\n", failures);
+    return failures;
+}
+
+int draughts_main(int argc, char **argv) {
+    if (argc >= 1 && strcmp(argv[0], "check") == 0)
+        return draughts_check(argc > 1 ? atoi(argv[1]) : 8) ? 1 : 0;
+    if (argc < 2 || strcmp(argv[0], "perft") != 0) {
+        printf("usage: draughts perft <depth> [position] [--divide] | draughts check [max_depth]\n");
+        return 1;
+    }
+    int depth = atoi(argv[1]);
+    int divide = 0;
+    const char *pos = "startpos";
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--divide") == 0) divide = 1;
+        else pos = argv[i];
+    }
+    Draughts d;
+    if (depth < 1 || !draughts_parse(pos, &d)) {
+        printf("Bad depth or position.\n");
+        return 1;
+    }
+
+    double t0 = now_seconds();
+    unsigned long long nodes = 0ULL;
+    if (divide) {
+        DMove moves[D_MAX_MOVES];
+        int n = draughts_moves(&d, moves);
+        for (int i = 0; i < n; ++i) {
+            Draughts next = d;
+            draughts_apply(&next, &moves[i]);
+            unsigned long long sub = draughts_perft(&next, depth - 1);
+            char buf[16];
+            draughts_move_string(&moves[i], buf);
+            printf("%-12s %llu\n", buf, sub);
+            nodes += sub;
+        }
+    } else {
+        nodes = draughts_perft(&d, depth);
+    }
+    double secs = now_seconds() - t0;
+    printf("perft(%d) = %llu  %.3f s  %.0f nps\n",
+           depth, nodes, secs, secs > 0 ? (double)nodes / secs : 0.0);
+    return 0;
+}
+
+#else
+
+int draughts_main(int argc, char **argv) {
+    (void)argc; (void)argv;
+    printf("International draughts needs a compiler with unsigned __int128.\n");
+    return 1;
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+/*
+
+   Perft: leaf node counts of the legal move tree
+
+   ./bitboard_checkers perft <depth> [position] [--divide]
+   ./bitboard_checkers perft check [max_depth]
+
+*/
+
+/* Known counts from the initial position, index = depth. */
+static const unsigned long long PERFT_REFERENCE[] = {
+    1ULL, 7ULL, 49ULL, 302ULL, 1469ULL, 7361ULL, 36768ULL, 179740ULL,
+    845931ULL, 3963680ULL, 18391564ULL, 85242128ULL, 388623673ULL
+};
+#define PERFT_REFERENCE_DEPTH ((int)(sizeof(PERFT_REFERENCE) / sizeof(PERFT_REFERENCE[0])) - 1)
+
+unsigned long long perft(GameState *g, int depth) {
+    if (depth == 0) return 1ULL;
+    Move moves[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    if (depth == 1) return (unsigned long long)n;
+    unsigned long long nodes = 0ULL;
+    for (int i = 0; i < n; ++i) {
+        Undo u;
+        make_move(g, &moves[i], &u);
+        nodes += perft(g, depth - 1);
+        unmake_move(g, &u);
+    }
+    return nodes;
+}
+
+/* Per-root-move counts, then the total. */
+unsigned long long perft_divide(GameState *g, int depth) {
+    Move moves[MAX_MOVES];
+    int n = generate_moves(g, g->turn, moves);
+    unsigned long long total = 0ULL;
+    for (int i = 0; i < n; ++i) {
+        Undo u;
+        make_move(g, &moves[i], &u);
+        unsigned long long nodes = perft(g, depth - 1);
+        unmake_move(g, &u);
+        char buf[MOVE_STR_LEN];
+        move_to_string(&moves[i], buf);
+        printf("%-12s %llu\n", buf, nodes);
+        total += nodes;
+    }
+    return total;
+}
+
+/* Counts depth 1..max_depth from the initial position against the
+   reference table.  Returns the number of mismatches. */
+int perft_check(int max_depth) {
+    if (max_depth > PERFT_REFERENCE_DEPTH) max_depth = PERFT_REFERENCE_DEPTH;
+    int failures = 0;
+    unsigned long long total = 0ULL;
+    double start = now_seconds();
+    for (int d = 1; d <= max_depth; ++d) {
+        GameState g;
+        init_game(&g);
+        double t0 = now_seconds();
+        unsigned long long nodes = perft(&g, d);
+        double secs = now_seconds() - t0;
+        int ok = (nodes == PERFT_REFERENCE[d]);
+        if (!ok) failures++;
+        total += nodes;
+        printf("depth %2d  nodes %12llu  expected %12llu  %s  %8.3f s  %12.0f nps\n",
+               d, nodes, PERFT_REFERENCE[d], ok ? "ok  " : "FAIL",
+               secs, secs > 0 ? (double)nodes / secs : 0.0);
+    }
+    double secs = now_seconds() - start;
+    printf("total %llu nodes in %.3f s (%.0f nps), %d failure(s)\n",
+           total, secs, secs > 0 ? (double)total / secs : 0.0, failures);
+    return failures;
+}
+
+int perft_main(int argc, char **argv) {
+    if (argc < 1) {
+        printf("usage: perft <depth> [position] [--divide] | perft check [max_depth]\n");
+        return 1;
+    }
+    if (strcmp(argv[0], "check") == 0) {
+        int max_depth = (argc > 1) ? atoi(argv[1]) : 10;
+        return perft_check(max_depth) ? 1 : 0;
+    }
+
+    int depth = atoi(argv[0]);
+    int divide = 0;
+    const char *pos = "startpos";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--divide") == 0) divide = 1;
+        else pos = argv[i];
+    }
+    GameState g;
+    if (depth < 1 || !parse_position(pos, &g)) {
+        printf("Bad depth or position.\n");
+        return 1;
+    }
+
+    double t0 = now_seconds();
+    unsigned long long nodes = divide ? perft_divide(&g, depth) : perft(&g, depth);
+    double secs = now_seconds() - t0;
+    printf("perft(%d) = %llu  %.3f s  %.0f nps\n",
+           depth, nodes, secs, secs > 0 ? (double)nodes / secs : 0.0);
+
+    GameState start;
+    init_game(&start);
+    if (g.key == start.key && g.red_man == start.red_man && g.blk_man == start.blk_man &&
+        !g.red_king && !g.blk_king && depth <= PERFT_REFERENCE_DEPTH) {
+        int ok = (nodes == PERFT_REFERENCE[depth]);
+        printf("reference %llu: %s\n", PERFT_REFERENCE[depth], ok ? "ok" : "MISMATCH");
+        return ok ? 0 : 1;
+    }
+    return 0;
 }
 
 void run_phase1_tests() {
@@ -565,12 +7665,73 @@ void run_phase1_tests() {
 }
 
 int main(int argc, char **argv) {
+    init_bitops();
+    init_zobrist();
+    if (argc > 1 && strcmp(argv[1], "perft") == 0) return perft_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "search") == 0) return search_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "stats") == 0) return stats_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "smpbench") == 0) return smpbench_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "tbgen") == 0) return tbgen_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "tbprobe") == 0) return tbprobe_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "bitbench") == 0) return bitbench_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "evalbench") == 0) return evalbench_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "nnue") == 0) return nnue_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "microbench") == 0) return microbench_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "protocol") == 0) return protocol_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "pdn") == 0) return pdn_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "records") == 0) return records_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "match") == 0) return match_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "solve") == 0) return solve_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "mcts") == 0) return mcts_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "server") == 0) return server_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "loadgen") == 0) return loadgen_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) return batch_main(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "draughts") == 0) return draughts_main(argc - 2, argv + 2);
+
+    int engine_side = -1;
+    int ponder = 0;
+    SearchLimits limits = SEARCH_LIMITS_DEFAULT;
+    size_t hash_mb = TT_DEFAULT_MB;
+    if (argc > 1 && strcmp(argv[1], "play") == 0) {
+        for (int i = 2; i < argc; ) {
+            int used = parse_limit_arg(argc - i, argv + i, &limits);
+            if (used) { i += used; continue; }
+            used = parse_tb_arg(argc - i, argv + i);
+            if (used < 0) return 1;
+            if (used) { i += used; continue; }
+            used = parse_nnue_arg(argc - i, argv + i);
+            if (used < 0) return 1;
+            if (used) { i += used; continue; }
+            if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+                hash_mb = (size_t)atoi(argv[i + 1]);
+                i += 2;
+                continue;
+            }
+            if (strcmp(argv[i], "--ponder") == 0) {
+                ponder = 1;
+                i++;
+                continue;
+            }
+            if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+                engine_side = (tolower((unsigned char)argv[i + 1][0]) == 'r') ? 0 : 1;
+                i += 2;
+                continue;
+            }
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        if (!limits.depth && !limits.nodes && !limits.movetime_ms) limits.movetime_ms = 1000;
+    }
+
     printf("BitBoard Checkers - Full Project Implementation\n");
     printf("Running Phase 1 tests...\n");
     run_phase1_tests();
 
     printf("Starting Phase 2: Playable Checkers game.\n");
-    play_game();
+    TransTable tt;
+    int have_tt = (engine_side >= 0) && tt_init(&tt, hash_mb);
+    play_game(engine_side, &limits, have_tt ? &tt : NULL, ponder);
+    if (have_tt) tt_free(&tt);
 
     printf("Thanks for playing. Goodbye!\n");
     return 0;